@@ -0,0 +1,537 @@
+#include "./filtered_string_view.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory_resource>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+// Micro-benchmarks for filtered_string_view
+// Usage: filtered_string_view_bench [number of tokens]
+
+namespace {
+	using bench_clock = std::chrono::steady_clock;
+
+	// Run fn once and return how long it took in milliseconds
+	template<typename F>
+	auto time_ms(F&& fn) -> double {
+		const auto start = bench_clock::now();
+		fn();
+		return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+	}
+
+	// Generate count random lowercase tokens of 3 to 12 characters, stored back to back and NUL-terminated
+	// like the pieces of a split document
+	auto make_tokens(std::size_t count) -> std::string {
+		auto rng = std::mt19937{6771};
+		auto length = std::uniform_int_distribution<std::size_t>{3, 12};
+		auto letter = std::uniform_int_distribution<int>{'a', 'z'};
+
+		auto buffer = std::string();
+		buffer.reserve(count * 9);
+		for (std::size_t i = 0; i < count; ++i) {
+			for (auto n = length(rng); n > 0; --n) {
+				buffer.push_back(static_cast<char>(letter(rng)));
+			}
+			buffer.push_back('\0');
+		}
+		return buffer;
+	}
+
+	// Call fn with a pointer to each NUL-terminated token in buffer
+	template<typename F>
+	auto for_each_token(const std::string& buffer, F&& fn) -> void {
+		for (std::size_t pos = 0; pos < buffer.size(); pos = buffer.find('\0', pos) + 1) {
+			fn(buffer.data() + pos);
+		}
+	}
+
+	// Iterate a sparse view forwards and backwards with a byte-class predicate, which steps a block at a time, and
+	// with an equivalent generic predicate, which tests every character
+	auto bench_sparse_iteration(std::size_t size) -> void {
+		auto text = std::string(size, ' ');
+		for (std::size_t i = 0; i < size; i += 97) {
+			text[i] = static_cast<char>('0' + i % 10);
+		}
+		const auto table = fsv::filtered_string_view(text, fsv::classes::digit);
+		const auto generic = fsv::filtered_string_view(text, [](const char& c) { return c >= '0' and c <= '9'; });
+
+		auto sum = std::size_t{0};
+		const auto forward = [&sum](const fsv::filtered_string_view& view) {
+			for (const auto c : view) {
+				sum += static_cast<unsigned char>(c);
+			}
+		};
+		const auto reverse = [&sum](const fsv::filtered_string_view& view) {
+			for (auto it = view.rbegin(); it != view.rend(); ++it) {
+				sum += static_cast<unsigned char>(*it);
+			}
+		};
+		const auto table_ms = time_ms([&] { forward(table); });
+		const auto table_reverse_ms = time_ms([&] { reverse(table); });
+		const auto generic_ms = time_ms([&] { forward(generic); });
+		const auto generic_reverse_ms = time_ms([&] { reverse(generic); });
+
+		std::cout << "sparse iteration (" << size / 1024 << " KiB, 1 kept per 97 bytes, checksum " << sum << ")\n"
+		          << "  byte_class: forward " << table_ms << " ms, reverse " << table_reverse_ms << " ms\n"
+		          << "  generic:    forward " << generic_ms << " ms, reverse " << generic_reverse_ms << " ms\n";
+	}
+
+	// Report the kernels in use, then time byte-class scans with each set of kernels the CPU supports
+	auto bench_kernels(const std::string& text) -> void {
+		const auto active = fsv::active_simd_level();
+		std::cout << "kernels: " << fsv::simd_level_name(active) << " (CPU supports "
+		          << fsv::simd_level_name(fsv::supported_simd_level()) << ")\n";
+
+		const auto view = fsv::filtered_string_view(text, fsv::classes::alpha | fsv::byte_class::of("_"));
+		const auto ranged = fsv::filtered_string_view(text, fsv::classes::lower);
+		for (auto level = fsv::simd_level::scalar; level <= fsv::supported_simd_level();
+		     level = static_cast<fsv::simd_level>(static_cast<int>(level) + 1))
+		{
+			fsv::use_simd_level(level);
+			auto kept = static_cast<std::string>(view).size(); // Warm up the caches and the allocator
+			const auto size_ms = time_ms([&] { kept += view.size() + ranged.size(); });
+			const auto copy_ms = time_ms([&] { kept += static_cast<std::string>(view).size(); });
+			std::cout << "  " << fsv::simd_level_name(level) << ": size " << size_ms << " ms, std::string " << copy_ms
+			          << " ms (" << kept << " kept)\n";
+		}
+		fsv::use_simd_level(active);
+	}
+
+	// Count letters, digits and punctuation in one buffer, with one view per class and with a single scan
+	auto bench_scan(const std::string& text) -> void {
+		const auto filts = std::vector<fsv::filter>{fsv::classes::alpha, fsv::classes::digit, fsv::classes::punct};
+
+		auto per_view = std::size_t{0};
+		const auto per_view_ms = time_ms([&] {
+			for (const auto& filt : filts) {
+				per_view += fsv::filtered_string_view(text, filt).size();
+			}
+		});
+		auto scanned = std::size_t{0};
+		const auto scan_ms = time_ms([&] {
+			for (const auto count : fsv::scan(text, filts).counts) {
+				scanned += count;
+			}
+		});
+
+		std::cout << "scan (" << text.size() / 1024 << " KiB, 3 classes, " << scanned << " kept)\n"
+		          << "  one view per class: " << per_view_ms << " ms (" << per_view << " kept)\n"
+		          << "  single scan:        " << scan_ms << " ms\n";
+	}
+
+	// Filter a column of tokens into one buffer, against building a view and a std::string per row
+	auto bench_filter_column(const std::string& tokens) -> void {
+		auto offsets = std::vector<std::size_t>{0};
+		for (std::size_t pos = tokens.find('\0'); pos != std::string::npos; pos = tokens.find('\0', pos + 1)) {
+			offsets.push_back(pos + 1);
+		}
+		const auto column = fsv::string_column{tokens, offsets};
+		const auto no_vowels = [](const char& c) {
+			return c != 'a' and c != 'e' and c != 'i' and c != 'o' and c != 'u';
+		};
+
+		auto rows = std::vector<std::string>();
+		const auto per_row_ms = time_ms([&] {
+			rows.reserve(offsets.size() - 1);
+			for (std::size_t row = 0; row + 1 < offsets.size(); ++row) {
+				rows.emplace_back(fsv::filtered_string_view(tokens.data() + offsets[row],
+				                                            offsets[row + 1] - offsets[row],
+				                                            no_vowels));
+			}
+		});
+		auto single = fsv::filtered_column();
+		const auto single_ms =
+		    time_ms([&] { single = fsv::filter_column(column, no_vowels, fsv::batch_options{.threads = 1}); });
+		auto parallel = fsv::filtered_column();
+		const auto parallel_ms = time_ms([&] { parallel = fsv::filter_column(column, no_vowels); });
+
+		std::cout << "filter_column (" << offsets.size() - 1 << " rows, " << parallel.data.size() << " bytes kept)\n"
+		          << "  view + std::string per row: " << per_row_ms << " ms\n"
+		          << "  filter_column, 1 thread:    " << single_ms << " ms\n"
+		          << "  filter_column, all threads: " << parallel_ms << " ms\n";
+	}
+
+	// Run write(fd) against the write end of a pipe whose read end is drained by another thread, returning the time
+	// write took and the number of bytes that came through
+	template<typename F>
+	auto time_pipe(F&& write) -> std::pair<double, std::size_t> {
+		auto fds = std::array<int, 2>();
+		if (::pipe(fds.data()) != 0) {
+			return {0, 0};
+		}
+		auto received = std::size_t{0};
+		auto reader = std::thread([&] {
+			auto buffer = std::array<char, 1 << 16>();
+			for (auto n = ::read(fds[0], buffer.data(), buffer.size()); n > 0;
+			     n = ::read(fds[0], buffer.data(), buffer.size()))
+			{
+				received += static_cast<std::size_t>(n);
+			}
+		});
+		const auto ms = time_ms([&] { write(fds[1]); });
+		::close(fds[1]);
+		reader.join();
+		::close(fds[0]);
+		return {ms, received};
+	}
+
+	// Write a filtered view of every token to a pipe and to a temporary file, with write_to and by converting each
+	// view to a std::string and writing that
+	auto bench_write_to(const std::string& tokens) -> void {
+		const auto no_vowels = fsv::predicate_handle(
+		    [](const char& c) { return not(c == 'a' or c == 'e' or c == 'i' or c == 'o' or c == 'u'); });
+		auto views = std::vector<fsv::filtered_string_view>();
+		for_each_token(tokens, [&](const char* token) { views.emplace_back(token, no_vowels); });
+
+		const auto batched = [&](int fd) { fsv::write_to(fd, views); };
+		const auto per_view = [&](int fd) {
+			for (const auto& view : views) {
+				fsv::write_to(fd, view);
+			}
+		};
+		const auto materialised = [&](int fd) {
+			for (const auto& view : views) {
+				const auto text = static_cast<std::string>(view);
+				for (std::size_t done = 0; done < text.size();) {
+					const auto n = ::write(fd, text.data() + done, text.size() - done);
+					if (n <= 0) {
+						return;
+					}
+					done += static_cast<std::size_t>(n);
+				}
+			}
+		};
+
+		const auto [pipe_batched_ms, pipe_bytes] = time_pipe(batched);
+		const auto [pipe_per_view_ms, pipe_per_view_bytes] = time_pipe(per_view);
+		const auto [pipe_materialised_ms, pipe_materialised_bytes] = time_pipe(materialised);
+
+		auto* file = std::tmpfile();
+		const auto file_ms = [&](const auto& write) {
+			static_cast<void>(::ftruncate(::fileno(file), 0));
+			::lseek(::fileno(file), 0, SEEK_SET);
+			return time_ms([&] { write(::fileno(file)); });
+		};
+		const auto file_batched_ms = file_ms(batched);
+		const auto file_per_view_ms = file_ms(per_view);
+		const auto file_materialised_ms = file_ms(materialised);
+		std::fclose(file);
+
+		const auto consistent = pipe_per_view_bytes == pipe_bytes and pipe_materialised_bytes == pipe_bytes;
+		std::cout << "write_to (" << views.size() << " views, " << pipe_bytes << " bytes"
+		          << (consistent ? "" : ", MISMATCH") << ")\n"
+		          << "  pipe: batched " << pipe_batched_ms << " ms, one writev per view " << pipe_per_view_ms
+		          << " ms, std::string + write " << pipe_materialised_ms << " ms\n"
+		          << "  file: batched " << file_batched_ms << " ms, one writev per view " << file_per_view_ms
+		          << " ms, std::string + write " << file_materialised_ms << " ms\n";
+	}
+
+	// Materialise every view in a hot loop as a fresh std::string, by appending to one reused string and by copying
+	// into one reused buffer
+	auto bench_copy_to(const std::string& tokens) -> void {
+		const auto consonants = fsv::predicate_handle(fsv::classes::lower & ~fsv::byte_class::of("aeiou"));
+		auto views = std::vector<fsv::filtered_string_view>();
+		for_each_token(tokens, [&](const char* token) { views.emplace_back(token, consonants); });
+
+		auto converted = std::size_t{0};
+		const auto convert_ms = time_ms([&] {
+			for (const auto& view : views) {
+				converted += static_cast<std::string>(view).size();
+			}
+		});
+		auto appended = std::size_t{0};
+		auto scratch = std::string();
+		const auto append_ms = time_ms([&] {
+			for (const auto& view : views) {
+				scratch.clear();
+				view.append_to(scratch);
+				appended += scratch.size();
+			}
+		});
+		auto copied = std::size_t{0};
+		auto buffer = std::array<char, 64>{};
+		const auto copy_ms = time_ms([&] {
+			for (const auto& view : views) {
+				copied += view.copy_to(buffer.data(), buffer.size());
+			}
+		});
+
+		const auto consistent = appended == converted and copied == converted;
+		std::cout << "copy_to (" << views.size() << " views, " << converted << " bytes"
+		          << (consistent ? "" : ", MISMATCH") << ")\n"
+		          << "  std::string conversion: " << convert_ms << " ms\n"
+		          << "  append_to scratch:      " << append_ms << " ms\n"
+		          << "  copy_to buffer:         " << copy_ms << " ms\n";
+	}
+
+	// Split lines of words and materialise each piece, with the global allocator and with a per-line arena that is
+	// released in one go
+	auto bench_pmr_split(const std::string& tokens) -> void {
+		auto lines = std::vector<std::string>();
+		for (std::size_t pos = 0; pos < tokens.size(); pos += 4096) {
+			auto line = tokens.substr(pos, 4096);
+			std::replace(line.begin(), line.end(), '\0', ' ');
+			lines.push_back(std::move(line));
+		}
+		const auto tok = fsv::filtered_string_view{" "};
+
+		auto heap_bytes = std::size_t{0};
+		const auto heap_ms = time_ms([&] {
+			for (const auto& line : lines) {
+				for (const auto& piece : fsv::split(fsv::filtered_string_view(line), tok)) {
+					heap_bytes += fsv::to_string(piece).size();
+				}
+			}
+		});
+		auto arena_bytes = std::size_t{0};
+		auto storage = std::vector<std::byte>(1 << 20);
+		const auto arena_ms = time_ms([&] {
+			for (const auto& line : lines) {
+				auto arena = std::pmr::monotonic_buffer_resource(storage.data(), storage.size());
+				for (const auto& piece : fsv::pmr::split(fsv::filtered_string_view(line), tok, &arena)) {
+					arena_bytes += fsv::pmr::to_string(piece, &arena).size();
+				}
+			}
+		});
+
+		std::cout << "split and to_string (" << lines.size() << " lines, " << heap_bytes << " bytes"
+		          << (arena_bytes == heap_bytes ? "" : ", MISMATCH") << ")\n"
+		          << "  global allocator: " << heap_ms << " ms\n"
+		          << "  monotonic arena:  " << arena_ms << " ms\n";
+	}
+
+	// Take owned copies of substrings long enough to defeat the small string optimisation, as std::string and as
+	// filtered_string drawing from a pool
+	auto bench_filtered_string(const std::string& tokens) -> void {
+		const auto letters = fsv::filtered_string_view(tokens, fsv::classes::lower);
+		const auto rounds = tokens.size() / 64;
+
+		auto string_bytes = std::size_t{0};
+		const auto string_ms = time_ms([&] {
+			for (std::size_t i = 0; i < rounds; ++i) {
+				const auto piece = fsv::filtered_string_view(tokens.data() + i * 64, 64, letters.shared_predicate());
+				string_bytes += static_cast<std::string>(piece).size();
+			}
+		});
+		auto pool = fsv::string_pool();
+		auto owned_bytes = std::size_t{0};
+		const auto owned_ms = time_ms([&] {
+			for (std::size_t i = 0; i < rounds; ++i) {
+				const auto piece = fsv::filtered_string_view(tokens.data() + i * 64, 64, letters.shared_predicate());
+				owned_bytes += fsv::filtered_string(piece, pool).size();
+			}
+		});
+
+		std::cout << "filtered_string (" << rounds << " copies, " << string_bytes << " bytes"
+		          << (owned_bytes == string_bytes ? "" : ", MISMATCH") << ", pool " << pool.slab_bytes() / 1024
+		          << " KiB)\n"
+		          << "  std::string:     " << string_ms << " ms\n"
+		          << "  filtered_string: " << owned_ms << " ms\n";
+	}
+
+	// Convert each of a set of request lines to std::string three times, as logging, hashing and a map lookup would,
+	// with plain and with memoized views
+	auto bench_memoized(const std::string& tokens) -> void {
+		const auto printable = fsv::predicate_handle(
+		    [](const char& c) { return c >= ' ' and c != 'a' and c != 'e' and c != 'i' and c != 'o' and c != 'u'; });
+		auto views = std::vector<fsv::filtered_string_view>();
+		for (std::size_t pos = 0; pos + 256 <= tokens.size(); pos += 256) {
+			views.emplace_back(tokens.data() + pos, 256, printable);
+		}
+		const auto convert = [](const std::vector<fsv::filtered_string_view>& requests) {
+			auto bytes = std::size_t{0};
+			for (const auto& request : requests) {
+				for (auto use = 0; use < 3; ++use) {
+					bytes += static_cast<std::string>(request).size();
+				}
+			}
+			return bytes;
+		};
+
+		auto plain_bytes = std::size_t{0};
+		const auto plain_ms = time_ms([&] { plain_bytes = convert(views); });
+		auto memo_bytes = std::size_t{0};
+		const auto memo_ms = time_ms([&] {
+			auto memoized = std::vector<fsv::filtered_string_view>();
+			memoized.reserve(views.size());
+			for (const auto& view : views) {
+				memoized.push_back(view.memoized());
+			}
+			memo_bytes = convert(memoized);
+		});
+
+		std::cout << "memoized (" << views.size() << " views x 3 conversions, " << plain_bytes << " bytes"
+		          << (memo_bytes == plain_bytes ? "" : ", MISMATCH") << ")\n"
+		          << "  plain:    " << plain_ms << " ms\n"
+		          << "  memoized: " << memo_ms << " ms\n";
+	}
+
+	// Materialise views of a small set of hot lines from several threads, each building its own views, directly and
+	// through a string_cache
+	auto bench_string_cache(const std::string& tokens) -> void {
+		const auto consonants = fsv::predicate_handle(
+		    [](const char& c) { return c != 'a' and c != 'e' and c != 'i' and c != 'o' and c != 'u'; });
+		constexpr auto hot_lines = std::size_t{256};
+		constexpr auto line_length = std::size_t{512};
+		constexpr auto lookups = std::size_t{50000};
+		const auto threads = std::max(std::size_t{std::thread::hardware_concurrency()}, std::size_t{2});
+
+		const auto run = [&](const auto& materialise) {
+			auto bytes = std::vector<std::size_t>(threads);
+			auto workers = std::vector<std::thread>();
+			for (std::size_t t = 0; t < threads; ++t) {
+				workers.emplace_back([&, t] {
+					for (std::size_t i = 0; i < lookups; ++i) {
+						const auto line = (i * 7 + t) % hot_lines;
+						bytes[t] += materialise(fsv::filtered_string_view(tokens.data() + line * line_length,
+						                                                  line_length,
+						                                                  consonants));
+					}
+				});
+			}
+			for (auto& worker : workers) {
+				worker.join();
+			}
+			return std::accumulate(bytes.begin(), bytes.end(), std::size_t{0});
+		};
+
+		auto direct_bytes = std::size_t{0};
+		const auto direct_ms = time_ms([&] {
+			direct_bytes = run([](const fsv::filtered_string_view& view) {
+				return static_cast<std::string>(view).size();
+			});
+		});
+		auto cache = fsv::string_cache();
+		auto cached_bytes = std::size_t{0};
+		const auto cached_ms = time_ms([&] {
+			cached_bytes = run([&](const fsv::filtered_string_view& view) { return cache.get(view)->size(); });
+		});
+
+		const auto stats = cache.stats();
+		std::cout << "string_cache (" << threads << " threads x " << lookups << " lookups, " << hot_lines
+		          << " distinct views" << (cached_bytes == direct_bytes ? "" : ", MISMATCH") << ")\n"
+		          << "  materialise each time: " << direct_ms << " ms\n"
+		          << "  string_cache:          " << cached_ms << " ms, hit rate " << stats.hit_rate() << "\n";
+	}
+
+	// Checked access at spread-out indices of a generic-predicate view, with at() alone and with the separate size()
+	// check at() used to make first
+	auto bench_at(const std::string& tokens) -> void {
+		auto view = fsv::filtered_string_view(tokens.data(),
+		                                      std::min(tokens.size(), std::size_t{1} << 16),
+		                                      [](const char& c) { return c != '\0'; });
+		const auto size = static_cast<int>(view.size());
+		constexpr auto accesses = 2000;
+
+		auto fused_sum = 0L;
+		const auto fused_ms = time_ms([&] {
+			for (auto i = 0; i < accesses; ++i) {
+				fused_sum += view.at(i * 7919 % size);
+			}
+		});
+		auto checked_sum = 0L;
+		const auto checked_ms = time_ms([&] {
+			for (auto i = 0; i < accesses; ++i) {
+				const auto index = i * 7919 % size;
+				if (index < static_cast<int>(view.size())) {
+					checked_sum += view.at(index);
+				}
+			}
+		});
+
+		std::cout << "at (" << accesses << " accesses into " << size << " kept"
+		          << (fused_sum == checked_sum ? "" : ", MISMATCH") << ")\n"
+		          << "  at():          " << fused_ms << " ms\n"
+		          << "  size() + at(): " << checked_ms << " ms\n";
+	}
+
+	// Tail a growing log, counting its digits after every append by re-wrapping the buffer and with a growing_view
+	auto bench_growing_view(std::size_t appends) -> void {
+		auto lines = std::vector<std::string>();
+		for (std::size_t i = 0; i < appends; ++i) {
+			lines.push_back("2024-06-01T12:00:00 request " + std::to_string(i) + " served\n");
+		}
+
+		auto log = std::string();
+		auto rewrapped = std::size_t{0};
+		const auto rewrap_ms = time_ms([&] {
+			for (const auto& line : lines) {
+				log += line;
+				rewrapped = fsv::filtered_string_view(log, fsv::classes::digit).size();
+			}
+		});
+		log.clear();
+		auto tail = fsv::growing_view(fsv::classes::digit);
+		auto grown = std::size_t{0};
+		const auto grow_ms = time_ms([&] {
+			for (const auto& line : lines) {
+				log += line;
+				grown = tail.extend(log);
+			}
+		});
+
+		std::cout << "growing_view (" << appends << " appends, " << log.size() / 1024 << " KiB, " << grown << " kept"
+		          << (grown == rewrapped ? "" : ", MISMATCH") << ")\n"
+		          << "  re-wrap and size(): " << rewrap_ms << " ms\n"
+		          << "  growing_view:       " << grow_ms << " ms\n";
+	}
+
+	// Compare the memory footprint and sort speed of full and compact views over the same tokens
+	auto bench_compact_view(const std::string& tokens, std::size_t count) -> void {
+		const auto no_vowels = fsv::predicate_handle(
+		    [](const char& c) { return not(c == 'a' or c == 'e' or c == 'i' or c == 'o' or c == 'u'); });
+
+		for (const auto filtered : {false, true}) {
+			auto full = std::vector<fsv::filtered_string_view>();
+			full.reserve(count);
+			for_each_token(tokens, [&](const char* token) {
+				full.push_back(filtered ? fsv::filtered_string_view(token, no_vowels)
+				                        : fsv::filtered_string_view(token));
+			});
+			auto compact = std::vector<fsv::compact_view>(full.begin(), full.end());
+
+			const auto full_ms = time_ms([&] { std::sort(full.begin(), full.end()); });
+			const auto compact_ms = time_ms([&] { std::sort(compact.begin(), compact.end()); });
+
+			std::cout << "compact_view (" << (filtered ? "filtered" : "unfiltered") << ", " << count
+			          << " tokens)\n"
+			          << "  filtered_string_view: " << sizeof(fsv::filtered_string_view) << " B/view, "
+			          << full.capacity() * sizeof(fsv::filtered_string_view) / 1024 << " KiB, sort " << full_ms
+			          << " ms\n"
+			          << "  compact_view:         " << sizeof(fsv::compact_view) << " B/view, "
+			          << compact.capacity() * sizeof(fsv::compact_view) / 1024 << " KiB, sort " << compact_ms
+			          << " ms\n";
+		}
+	}
+} // namespace
+
+auto main(int argc, char* argv[]) -> int {
+	const auto count = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : std::size_t{1000000};
+	const auto tokens = make_tokens(count);
+
+	bench_kernels(tokens);
+	bench_compact_view(tokens, count);
+	bench_sparse_iteration(tokens.size());
+	bench_filter_column(tokens);
+	bench_scan(tokens);
+	bench_write_to(tokens);
+	bench_copy_to(tokens);
+	bench_pmr_split(tokens);
+	bench_filtered_string(tokens);
+	bench_memoized(tokens);
+	bench_string_cache(tokens);
+	bench_at(tokens);
+	bench_growing_view(count / 50);
+	return 0;
+}
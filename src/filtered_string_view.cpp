@@ -1,8 +1,347 @@
 #include "./filtered_string_view.h"
+#include "./filtered_string_view.kernels.h"
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <exception>
+#include <limits>
+#include <numeric>
+#include <mutex>
 #include <sstream>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/uio.h>
 
 namespace fsv {
 
+	namespace {
+		// The distance from base to p, computed on the addresses as integers so that the pointers need not point
+		// into the same array. A p before base wraps around to more than any real offset
+		auto offset_from(const char* base, const char* p) noexcept -> std::size_t {
+			const auto distance = reinterpret_cast<std::uintptr_t>(p) - reinterpret_cast<std::uintptr_t>(base);
+			return static_cast<std::size_t>(distance);
+		}
+
+		// The state shared by every handle to the default predicate, it lives for the whole program
+		auto default_predicate_state() -> const detail::predicate_state& {
+			static const detail::predicate_state state{filtered_string_view::default_predicate,
+			                                           detail::predicate_kind::identity,
+			                                           byte_class::all(),
+			                                           {},
+			                                           {},
+			                                           {0}};
+			return state;
+		}
+
+		// Whether predicate wraps the default predicate function, which makes it the identity filter
+		auto is_default_function(const filter& predicate) -> bool {
+			const auto* fn = predicate.target<bool (*)(const char&)>();
+			return fn != nullptr and *fn == &filtered_string_view::default_predicate;
+		}
+
+		// Allocate a new state for predicate, or return null for the identity filter, which shares the default state
+		// A byte_class is recorded as a table and a bitmask filter as a mask, so scans can test them without calling
+		// through std::function
+		auto make_predicate_state(filter predicate) -> const detail::predicate_state* {
+			if (is_default_function(predicate)) {
+				return nullptr;
+			}
+			if (const auto* table = predicate.target<byte_class>()) {
+				const auto cls = *table;
+				return new detail::predicate_state{std::move(predicate),
+				                                   detail::predicate_kind::table,
+				                                   cls,
+				                                   detail::make_simd_table(cls),
+				                                   {},
+				                                   {1}};
+			}
+			if (const auto* filter = predicate.target<detail::mask_filter>()) {
+				auto mask = filter->mask;
+				return new detail::predicate_state{std::move(predicate),
+				                                   detail::predicate_kind::mask,
+				                                   {},
+				                                   {},
+				                                   std::move(mask),
+				                                   {1}};
+			}
+			return new detail::predicate_state{std::move(predicate), detail::predicate_kind::generic, {}, {}, {}, {1}};
+		}
+
+		// Call fn with a callable that tests one character against state
+		// Identity and byte-class predicates get a callable the compiler can inline into fn's loop
+		template<typename F>
+		auto with_predicate(const detail::predicate_state& state, F&& fn) -> decltype(auto) {
+			switch (state.kind) {
+			case detail::predicate_kind::identity: return fn([](const char&) { return true; });
+			case detail::predicate_kind::table: return fn(state.table);
+			case detail::predicate_kind::mask: return fn(*state.mask);
+			case detail::predicate_kind::generic: break;
+			}
+			return fn(state.fn);
+		}
+
+		// Bit i of the result is set when table keeps p[i], for the first n <= 64 characters of p
+		// Whole blocks go to the SIMD kernels, this handles the partial block at the end of a range
+		auto keep_mask(const byte_class& table, const char* p, std::size_t n) -> std::uint64_t {
+			auto mask = std::uint64_t{0};
+			for (std::size_t i = 0; i < n; ++i) {
+				mask |= static_cast<std::uint64_t>(table.contains(p[i])) << i;
+			}
+			return mask;
+		}
+
+		// Bit i of the result is set when state keeps p[i], for the first n <= 64 characters of p
+		auto block_mask(const detail::predicate_state& state, const char* p, std::size_t n) -> std::uint64_t {
+			if (state.kind == detail::predicate_kind::table) {
+				return n == 64 ? detail::active_kernels().classify(state.simd, p) : keep_mask(state.table, p, n);
+			}
+			if (state.kind == detail::predicate_kind::mask) {
+				const auto offset = state.mask->offset_of(p);
+				if (offset <= state.mask->length and n <= state.mask->length - offset) {
+					return state.mask->bits(offset, n);
+				}
+			}
+			return with_predicate(state, [&](const auto& keep) {
+				auto mask = std::uint64_t{0};
+				for (std::size_t i = 0; i < n; ++i) {
+					mask |= static_cast<std::uint64_t>(keep(p[i])) << i;
+				}
+				return mask;
+			});
+		}
+
+		// Call fn(block, mask) for each 64-character block of [p, p + n) with the block's keep mask, while fn returns
+		// true. Returns whether every block was visited
+		template<typename F>
+		auto for_each_block(const detail::predicate_state& state, const char* p, std::size_t n, F&& fn) -> bool {
+			for (std::size_t offset = 0; offset < n; offset += 64) {
+				if (not fn(p + offset, block_mask(state, p + offset, std::min(std::size_t{64}, n - offset)))) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// Call fn(first, count) for each run of consecutive kept characters of [p, p + n)
+		// Runs that reach the end of a block are held open, so a run spanning several blocks is reported once
+		template<typename F>
+		auto for_each_run(const detail::predicate_state& state, const char* p, std::size_t n, F&& fn) -> void {
+			const char* open = nullptr; // Start of the run not yet reported, if any
+			auto open_count = std::size_t{0};
+			for_each_block(state, p, n, [&](const char* block, std::uint64_t mask) {
+				while (mask != 0) {
+					const auto start = std::countr_zero(mask);
+					const auto run = std::countr_one(mask >> start);
+					if (open != nullptr and open + open_count == block + start) { // Continues the open run
+						open_count += static_cast<std::size_t>(run);
+					}
+					else {
+						if (open != nullptr) {
+							fn(open, open_count);
+						}
+						open = block + start;
+						open_count = static_cast<std::size_t>(run);
+					}
+					mask = run == 64 ? 0 : mask & ~(((std::uint64_t{1} << run) - 1) << start);
+				}
+				return true;
+			});
+			if (open != nullptr) {
+				fn(open, open_count);
+			}
+		}
+
+		// Whether iterators over state should step through block masks rather than test every character
+		auto steps_by_block(const detail::predicate_state& state) -> bool {
+			return state.kind == detail::predicate_kind::table or state.kind == detail::predicate_kind::mask;
+		}
+
+		// Call fn(first, count) for each run of consecutive kept characters of [p, p + n), whatever the predicate
+		template<typename F>
+		auto for_each_kept_run(const detail::predicate_state& state, const char* p, std::size_t n, F&& fn) -> void {
+			if (state.kind == detail::predicate_kind::identity) {
+				if (n != 0) {
+					fn(p, n);
+				}
+				return;
+			}
+			if (steps_by_block(state)) {
+				for_each_run(state, p, n, fn);
+				return;
+			}
+			with_predicate(state, [&](const auto& keep) {
+				const char* run = nullptr; // Start of the current run, if any
+				for (const char* c = p; c != p + n; ++c) {
+					if (keep(*c)) {
+						run = run != nullptr ? run : c;
+					}
+					else if (run != nullptr) {
+						fn(run, static_cast<std::size_t>(c - run));
+						run = nullptr;
+					}
+				}
+				if (run != nullptr) {
+					fn(run, static_cast<std::size_t>(p + n - run));
+				}
+			});
+		}
+
+		// Test a single character against state, for code that cannot hoist the dispatch out of a loop
+		auto keeps(const detail::predicate_state& state, const char& c) -> bool {
+			switch (state.kind) {
+			case detail::predicate_kind::identity: return true;
+			case detail::predicate_kind::table: return state.table.contains(c);
+			case detail::predicate_kind::mask: return state.mask->contains(c);
+			case detail::predicate_kind::generic: break;
+			}
+			return state.fn(c);
+		}
+
+		// Interned predicates live in segments of doubling size: segment s holds ids [2^s, 2^(s + 1))
+		// Published entries never move, so lookups do not need to take the lock
+		struct predicate_registry {
+			std::mutex mutex; // Serialises interning
+			std::atomic<std::uint32_t> next_id = 1; // Id 0 is reserved for the default predicate
+			std::array<std::atomic<predicate_handle*>, std::numeric_limits<std::uint32_t>::digits> segments = {};
+		};
+
+		// Constant-initialised, so lookups never pay for a function-local static guard
+		constinit auto registry_instance = predicate_registry();
+
+		auto registry() -> predicate_registry& {
+			return registry_instance;
+		}
+
+		auto registry_segment(std::uint32_t id) -> std::size_t {
+			return static_cast<std::size_t>(std::bit_width(id) - 1);
+		}
+	} // namespace
+
+	// Evaluate predicate for every byte value and collect the values it keeps
+	auto tabulate(const filter& predicate) -> byte_class {
+		auto result = byte_class();
+		for (auto b = 0U; b <= std::numeric_limits<unsigned char>::max(); ++b) {
+			const auto c = static_cast<char>(b);
+			if (predicate(c)) {
+				result.insert(c);
+			}
+		}
+		return result;
+	}
+
+	// Predicate handle
+	predicate_handle::predicate_handle() noexcept = default;
+
+	predicate_handle::predicate_handle(filter predicate)
+	: state_(make_predicate_state(std::move(predicate))) {}
+
+	auto predicate_handle::operator()(const char& c) const -> bool {
+		return state().fn(c);
+	}
+
+	auto predicate_handle::get() const noexcept -> const filter& {
+		return state().fn;
+	}
+
+	auto predicate_handle::use_count() const noexcept -> long {
+		return state_.use_count();
+	}
+
+	auto predicate_handle::is_default() const noexcept -> bool {
+		return state().kind == detail::predicate_kind::identity;
+	}
+
+	auto predicate_handle::state() const noexcept -> const detail::predicate_state& {
+		return state_ ? *state_.get() : default_predicate_state();
+	}
+
+	auto predicate_handle::id() const -> std::uint32_t {
+		if (is_default()) {
+			return 0;
+		}
+		if (auto id = state_->id.load(std::memory_order_acquire); id != 0) {
+			return id; // Already interned
+		}
+
+		auto& reg = registry();
+		const auto lock = std::lock_guard<std::mutex>(reg.mutex);
+		if (auto id = state_->id.load(std::memory_order_relaxed); id != 0) {
+			return id; // Interned by another thread while we waited
+		}
+
+		const auto id = reg.next_id.load(std::memory_order_relaxed);
+		if (id == 0) { // next_id wrapped around
+			throw std::length_error("predicate_handle::id(): predicate registry is full");
+		}
+		const auto segment = registry_segment(id);
+		auto* entries = reg.segments[segment].load(std::memory_order_relaxed);
+		if (entries == nullptr) {
+			entries = new predicate_handle[std::size_t{1} << segment];
+			reg.segments[segment].store(entries, std::memory_order_release);
+		}
+		entries[id - (std::uint32_t{1} << segment)] = *this; // The registry keeps the predicate alive
+
+		reg.next_id.store(id + 1, std::memory_order_release);
+		state_->id.store(id, std::memory_order_release);
+		return id;
+	}
+
+	auto predicate_handle::from_id(std::uint32_t id) -> const predicate_handle& {
+		static const predicate_handle default_handle;
+		if (id == 0) {
+			return default_handle;
+		}
+
+		auto& reg = registry();
+		if (id >= reg.next_id.load(std::memory_order_acquire)) {
+			std::ostringstream oss;
+			oss << "predicate_handle::from_id(" << id << "): unknown id";
+			throw std::out_of_range(oss.str());
+		}
+		const auto segment = registry_segment(id);
+		return reg.segments[segment].load(std::memory_order_acquire)[id - (std::uint32_t{1} << segment)];
+	}
+
+	// Shared buffer
+	shared_buffer::shared_buffer() noexcept = default;
+
+	shared_buffer::shared_buffer(std::string text)
+	: state_(new detail::buffer_state{std::move(text), 1}) {}
+
+	shared_buffer::shared_buffer(std::string_view text)
+	: shared_buffer(std::string(text)) {}
+
+	shared_buffer::shared_buffer(const char* text)
+	: shared_buffer(std::string(text)) {}
+
+	auto shared_buffer::data() const noexcept -> const char* {
+		return state_ ? state_->text.data() : nullptr;
+	}
+
+	auto shared_buffer::size() const noexcept -> std::size_t {
+		return state_ ? state_->text.size() : 0;
+	}
+
+	auto shared_buffer::use_count() const noexcept -> long {
+		return state_.use_count();
+	}
+
+	auto shared_buffer::contains(const char* first, std::size_t length) const noexcept -> bool {
+		if (not state_) {
+			return false;
+		}
+		const auto offset = offset_from(state_->text.data(), first);
+		return offset <= state_->text.size() and length <= state_->text.size() - offset;
+	}
+
+	shared_buffer::operator bool() const noexcept {
+		return static_cast<bool>(state_);
+	}
+
 	// The default predicate function, which always returns true
 	auto filtered_string_view::default_predicate(const char&) -> bool {
 		return true;
@@ -13,13 +352,13 @@ namespace fsv {
 	filtered_string_view::filtered_string_view()
 	: pointer_(nullptr)
 	, length_(0)
-	, predicate_(default_predicate) {}
+	, predicate_() {}
 
 	// 2.4.2 Implicit String Constructor
 	filtered_string_view::filtered_string_view(const std::string& s)
 	: pointer_(s.data())
 	, length_(s.size())
-	, predicate_(default_predicate) {}
+	, predicate_() {}
 
 	// 2.4.3 String Constructor with Predicate
 	filtered_string_view::filtered_string_view(const std::string& s, filter predicate)
@@ -31,7 +370,7 @@ namespace fsv {
 	filtered_string_view::filtered_string_view(const char* str)
 	: pointer_(str)
 	, length_(std::strlen(str)) // Use strlen to calculate the length of str
-	, predicate_(default_predicate) {}
+	, predicate_() {}
 
 	// 2.4.5 Null-Terminated String with Predicate Constructor
 	filtered_string_view::filtered_string_view(const char* str, filter predicate)
@@ -39,17 +378,170 @@ namespace fsv {
 	, length_(std::strlen(str)) // Use strlen to calculate the length of str
 	, predicate_(std::move(predicate)) {}
 
+	// String Constructor with a tabulated predicate
+	filtered_string_view::filtered_string_view(const std::string& s, filter predicate, tabulate_t)
+	: pointer_(s.data())
+	, length_(s.size())
+	, predicate_(filter(tabulate(predicate))) {}
+
+	// Null-Terminated String Constructor with a tabulated predicate
+	filtered_string_view::filtered_string_view(const char* str, filter predicate, tabulate_t)
+	: pointer_(str)
+	, length_(std::strlen(str)) // Use strlen to calculate the length of str
+	, predicate_(filter(tabulate(predicate))) {}
+
+	// String Constructor sharing an existing predicate
+	filtered_string_view::filtered_string_view(const std::string& s, predicate_handle predicate)
+	: pointer_(s.data())
+	, length_(s.size())
+	, predicate_(std::move(predicate)) {}
+
+	// Null-Terminated String Constructor sharing an existing predicate
+	filtered_string_view::filtered_string_view(const char* str, predicate_handle predicate)
+	: pointer_(str)
+	, length_(std::strlen(str)) // Use strlen to calculate the length of str
+	, predicate_(std::move(predicate)) {}
+
+	// Implicit string_view Constructor
+	filtered_string_view::filtered_string_view(std::string_view str)
+	: pointer_(str.data())
+	, length_(str.size())
+	, predicate_() {}
+
+	// string_view Constructor with Predicate
+	filtered_string_view::filtered_string_view(std::string_view str, filter predicate)
+	: pointer_(str.data())
+	, length_(str.size())
+	, predicate_(std::move(predicate)) {}
+
+	// string_view Constructor sharing an existing predicate
+	filtered_string_view::filtered_string_view(std::string_view str, predicate_handle predicate)
+	: pointer_(str.data())
+	, length_(str.size())
+	, predicate_(std::move(predicate)) {}
+
+	// View exactly length characters starting at data
+	filtered_string_view::filtered_string_view(const char* data, std::size_t length)
+	: pointer_(data)
+	, length_(length)
+	, predicate_() {}
+
+	// View exactly length characters starting at data with Predicate
+	filtered_string_view::filtered_string_view(const char* data, std::size_t length, filter predicate)
+	: pointer_(data)
+	, length_(length)
+	, predicate_(std::move(predicate)) {}
+
+	// View exactly length characters starting at data, sharing an existing predicate
+	filtered_string_view::filtered_string_view(const char* data, std::size_t length, predicate_handle predicate)
+	: pointer_(data)
+	, length_(length)
+	, predicate_(std::move(predicate)) {}
+
+	// View all of an owned buffer
+	filtered_string_view::filtered_string_view(shared_buffer buffer)
+	: filtered_string_view(std::move(buffer), predicate_handle()) {}
+
+	// View all of an owned buffer with Predicate
+	filtered_string_view::filtered_string_view(shared_buffer buffer, filter predicate)
+	: filtered_string_view(std::move(buffer), predicate_handle(std::move(predicate))) {}
+
+	// View all of an owned buffer, sharing an existing predicate
+	filtered_string_view::filtered_string_view(shared_buffer buffer, predicate_handle predicate)
+	: pointer_(buffer.data())
+	, length_(buffer.size())
+	, predicate_(std::move(predicate))
+	, owner_(std::move(buffer)) {}
+
+	// View exactly length characters starting at data, keeping the buffer holding them alive
+	filtered_string_view::filtered_string_view(const char* data,
+	                                           std::size_t length,
+	                                           predicate_handle predicate,
+	                                           shared_buffer owner)
+	: pointer_(data)
+	, length_(length)
+	, predicate_(std::move(predicate))
+	, owner_(std::move(owner)) {
+		if (owner_ and not owner_.contains(data, length)) {
+			throw std::out_of_range("filtered_string_view: the characters are not inside the owned buffer");
+		}
+	}
+
+	namespace {
+		auto mask_predicate(const char* data, std::size_t length, std::vector<std::uint64_t> words)
+		    -> predicate_handle {
+			auto mask = detail::bitmask{data, length, std::move(words)};
+			return predicate_handle(detail::mask_filter{std::make_shared<const detail::bitmask>(std::move(mask))});
+		}
+
+		// Copy the first (length + 63) / 64 words of mask, clearing the bits past length
+		auto mask_words(std::size_t length, std::span<const std::uint64_t> mask) -> std::vector<std::uint64_t> {
+			const auto count = (length + 63) / 64;
+			if (mask.size() < count) {
+				throw std::invalid_argument("filtered_string_view: the mask is shorter than the data");
+			}
+			auto words = std::vector<std::uint64_t>(mask.begin(), mask.begin() + static_cast<std::ptrdiff_t>(count));
+			if (length % 64 != 0) {
+				words.back() &= (std::uint64_t{1} << (length % 64)) - 1;
+			}
+			return words;
+		}
+
+		// Set the bits of every range, a whole word at a time where possible
+		auto range_words(std::size_t length, std::span<const keep_range> ranges) -> std::vector<std::uint64_t> {
+			auto words = std::vector<std::uint64_t>((length + 63) / 64);
+			for (const auto& range : ranges) {
+				if (range.offset > length or range.length > length - range.offset) {
+					throw std::out_of_range("filtered_string_view: a keep range reaches past the end of the data");
+				}
+				for (auto first = range.offset, last = range.offset + range.length; first < last;) {
+					const auto shift = first % 64;
+					const auto n = std::min(64 - shift, last - first);
+					words[first / 64] |= (n == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << n) - 1) << shift;
+					first += n;
+				}
+			}
+			return words;
+		}
+	} // namespace
+
+	// View exactly length characters starting at data, keeping those selected by mask
+	filtered_string_view::filtered_string_view(const char* data,
+	                                           std::size_t length,
+	                                           std::span<const std::uint64_t> mask)
+	: pointer_(data)
+	, length_(length)
+	, predicate_(mask_predicate(data, length, mask_words(length, mask))) {}
+
+	// View exactly length characters starting at data, keeping those inside ranges
+	filtered_string_view::filtered_string_view(const char* data, std::size_t length, std::span<const keep_range> ranges)
+	: pointer_(data)
+	, length_(length)
+	, predicate_(mask_predicate(data, length, range_words(length, ranges))) {}
+
+	// string_view Constructor keeping the characters selected by mask
+	filtered_string_view::filtered_string_view(std::string_view str, std::span<const std::uint64_t> mask)
+	: filtered_string_view(str.data(), str.size(), mask) {}
+
+	// string_view Constructor keeping the characters inside ranges
+	filtered_string_view::filtered_string_view(std::string_view str, std::span<const keep_range> ranges)
+	: filtered_string_view(str.data(), str.size(), ranges) {}
+
 	// 2.4.6 Copy Constructor
 	filtered_string_view::filtered_string_view(const filtered_string_view& other)
 	: pointer_(other.pointer_)
 	, length_(other.length_)
-	, predicate_(other.predicate_) {}
+	, predicate_(other.predicate_)
+	, owner_(other.owner_)
+	, memo_(other.memo_) {}
 
 	// 2.4.6 Move Constructor
 	filtered_string_view::filtered_string_view(filtered_string_view&& other) noexcept
 	: pointer_(other.pointer_)
 	, length_(other.length_)
-	, predicate_(std::move(other.predicate_)) { // Transfer other's resources to the new object
+	, predicate_(std::move(other.predicate_))
+	, owner_(std::move(other.owner_))
+	, memo_(std::move(other.memo_)) { // Transfer other's resources to the new object
 		other.pointer_ = nullptr; // Make sure the pointer no longer points to other
 		other.length_ = 0; // Clear the length of other
 	}
@@ -61,6 +553,8 @@ namespace fsv {
 			pointer_ = other.pointer_;
 			length_ = other.length_;
 			predicate_ = other.predicate_;
+			owner_ = other.owner_;
+			memo_ = other.memo_;
 		}
 		return *this;
 	}
@@ -70,6 +564,8 @@ namespace fsv {
 			pointer_ = other.pointer_;
 			length_ = other.length_;
 			predicate_ = std::move(other.predicate_); // Transfer other's resources to the new object
+			owner_ = std::move(other.owner_);
+			memo_ = std::move(other.memo_);
 
 			other.pointer_ = nullptr; // Make sure the pointer no longer points to other
 			other.length_ = 0; // Clear the length of other
@@ -82,66 +578,200 @@ namespace fsv {
 
 	// 2.5.4 [Overloading of [] to read the character at a specific index position in fsc
 	auto filtered_string_view::operator[](int n) const -> const char& {
-		const char* temp_ptr = pointer_;
-		int count = 0;
+		const auto* found = find_kept(n);
+		return found != nullptr ? *found : default_char;
+	}
+
+	// Locate the nth kept character in a single pass, the same pass telling whether there is one at all
+	auto filtered_string_view::find_kept(int n) const -> const char* {
+		if (n < 0) {
+			return nullptr;
+		}
+		if (unfiltered()) { // Every character is kept, so index directly
+			return static_cast<std::size_t>(n) < length_ ? pointer_ + n : nullptr;
+		}
+		if (memo_ and memo_->ready.load(std::memory_order_acquire)
+		    and static_cast<std::size_t>(n) >= memo_->size)
+		{
+			return nullptr; // The cached size rules n out without a scan
+		}
 
-		while (*temp_ptr != '\0') { // Loop through the underlying data
-			if (predicate_(*temp_ptr)) { // Check whether the current character meets the filtering
-				if (count == n) {
-					return *temp_ptr; // Return when the nth matching character is found
+		if (steps_by_block(predicate_.state())) { // Skip whole blocks by their popcount
+			auto remaining = static_cast<std::size_t>(n);
+			const char* found = nullptr;
+			for_each_block(predicate_.state(), pointer_, length_, [&](const char* block, std::uint64_t mask) {
+				const auto count = static_cast<std::size_t>(std::popcount(mask));
+				if (remaining >= count) {
+					remaining -= count;
+					return true;
 				}
-				count++;
-			}
-			temp_ptr++;
+				for (; remaining > 0; --remaining) {
+					mask &= mask - 1;
+				}
+				found = block + std::countr_zero(mask);
+				return false;
+			});
+			return found;
 		}
 
-		return default_char; // Return the default character if index n exceeds the number of qualifying characters
+		return with_predicate(predicate_.state(), [&](const auto& keep) -> const char* {
+			int count = 0; // Number of kept characters passed so far
+			for (const char* c = pointer_; c != pointer_ + length_; ++c) {
+				if (keep(*c)) {
+					if (count == n) {
+						return c;
+					}
+					count++;
+				}
+			}
+			return nullptr; // Fewer than n + 1 characters are kept
+		});
 	}
 
 	// 2.5.5 Overloading of std::string, allowing fsv to be explicitly converted to std::string
 	filtered_string_view::operator std::string() const {
 		std::string result;
-		result.reserve(length_); // The maximum length of the result is the length of the original string
-
-		// Use copy_if and back_inserter to add all characters that match the predicate to the result string
-		std::copy_if(pointer_, pointer_ + length_, std::back_inserter(result), predicate_);
-
+		if (const auto* memo = filled_memo(); memo != nullptr) {
+			if (memo->kept) {
+				return memo->text;
+			}
+			result.reserve(memo->size); // Too long to keep, but its size is known
+		}
+		else if (not unfiltered() and not steps_by_block(predicate_.state())) {
+			// Counting first would call the predicate twice, so reserve the most the result can hold
+			result.reserve(length_);
+		}
+		append_kept(result);
 		return result;
 	}
 
 	// 2.6 Member Functions
 	// 2.6.1 Return a character from the fsv according to the index
 	auto filtered_string_view::at(int index) -> const char& {
-		if (index < 0 or index >= static_cast<int>(size())) {
+		// The scan for the character doubles as the bounds check, there is no separate call to size()
+		const auto* found = find_kept(index);
+		if (found == nullptr) {
 			std::ostringstream oss;
 			oss << "filtered_string_view::at(" << index << "): invalid index";
 			throw std::domain_error(oss.str());
 		}
+		return *found;
+	}
 
-		const char* temp_ptr = pointer_; // Initialize the pointer to the starting position of the underlying data
-		int count = 0; // Record the number of characters that meet the predicate condition
+	// 2.6.2 Return the size of the fsv
+	auto filtered_string_view::size() const -> std::size_t {
+		if (const auto* memo = filled_memo()) {
+			return memo->size;
+		}
+		return count_kept();
+	}
 
-		while (*temp_ptr != '\0') { // Loop through the underlying data
-			if (predicate_(*temp_ptr)) { // Check whether the current character meets the filtering
-				if (count == index) { // Return when the character matching the criteria is found.
-					return *temp_ptr;
-				}
-				count++;
+	auto filtered_string_view::count_kept() const -> std::size_t {
+		if (unfiltered()) { // No need to call the predicate when it keeps every character
+			return length_;
+		}
+		if (steps_by_block(predicate_.state())) { // Count 64 characters per popcount
+			auto count = std::size_t{0};
+			for_each_block(predicate_.state(), pointer_, length_, [&](const char*, std::uint64_t mask) {
+				count += static_cast<std::size_t>(std::popcount(mask));
+				return true;
+			});
+			return count;
+		}
+		return with_predicate(predicate_.state(), [&](const auto& keep) {
+			return static_cast<std::size_t>(std::count_if(pointer_, pointer_ + length_, keep));
+		});
+	}
+
+	auto filtered_string_view::copy_to(char* dst, std::size_t cap) const -> std::size_t {
+		// Use the cache when it is filled, but do not fill it: copy_to must not allocate
+		if (memo_ and memo_->ready.load(std::memory_order_acquire) and memo_->kept) {
+			const auto count = std::min(cap, memo_->size);
+			if (count != 0) {
+				std::memcpy(dst, memo_->text.data(), count);
+			}
+			return count;
+		}
+		if (unfiltered()) {
+			const auto count = std::min(cap, length_);
+			if (count != 0) {
+				std::memcpy(dst, pointer_, count);
 			}
-			temp_ptr++;
+			return count;
+		}
+
+		auto written = std::size_t{0};
+		if (steps_by_block(predicate_.state())) { // Copy whole runs, stopping at the first block that fills dst
+			for_each_block(predicate_.state(), pointer_, length_, [&](const char* block, std::uint64_t mask) {
+				while (mask != 0 and written != cap) {
+					const auto start = std::countr_zero(mask);
+					const auto run = std::countr_one(mask >> start);
+					const auto count = std::min(static_cast<std::size_t>(run), cap - written);
+					std::memcpy(dst + written, block + start, count);
+					written += count;
+					mask = run == 64 ? 0 : mask & ~(((std::uint64_t{1} << run) - 1) << start);
+				}
+				return written != cap;
+			});
+			return written;
 		}
 
-		return default_char; // Return the default character if index n exceeds the number of qualifying characters
+		with_predicate(predicate_.state(), [&](const auto& keep) {
+			for (const char* c = pointer_; c != pointer_ + length_ and written != cap; ++c) {
+				if (keep(*c)) {
+					dst[written++] = *c;
+				}
+			}
+		});
+		return written;
+	}
+
+	auto filtered_string_view::append_to(std::string& out) const -> void {
+		if (const auto* memo = filled_memo(); memo != nullptr and memo->kept) {
+			out += memo->text;
+			return;
+		}
+		append_kept(out);
 	}
 
-	// 2.6.2 Return the size of the fsv
-	auto filtered_string_view::size() const -> std::size_t {
-		return static_cast<std::size_t>(std::count_if(pointer_, pointer_ + length_, predicate_));
+	auto filtered_string_view::append_kept(std::string& out) const -> void {
+		if (unfiltered()) {
+			out.append(pointer_, length_);
+			return;
+		}
+
+		if (steps_by_block(predicate_.state())) {
+			// Counting is a popcount per block, so an exact reservation is cheaper than growing while appending.
+			// Keep doubling when it has to grow so that appending many views to one string stays linear
+			const auto needed = out.size() + count_kept();
+			if (needed > out.capacity()) {
+				out.reserve(std::max(needed, 2 * out.capacity()));
+			}
+			for_each_run(predicate_.state(), pointer_, length_, [&](const char* run, std::size_t count) {
+				out.append(run, count);
+			});
+			return;
+		}
+
+		// Use copy_if and back_inserter to add all characters that match the predicate to the result string
+		with_predicate(predicate_.state(), [&](const auto& keep) {
+			std::copy_if(pointer_, pointer_ + length_, std::back_inserter(out), keep);
+		});
 	}
 
 	// 2.6.3 Return whether the fsv is empty
 	auto filtered_string_view::empty() const -> bool {
-		return size() == 0;
+		if (memo_ and memo_->ready.load(std::memory_order_acquire)) {
+			return memo_->size == 0;
+		}
+		// Stop at the first kept character instead of counting them all
+		if (steps_by_block(predicate_.state())) {
+			return for_each_block(predicate_.state(), pointer_, length_, [](const char*, std::uint64_t mask) {
+				return mask == 0;
+			});
+		}
+		return with_predicate(predicate_.state(),
+		                      [&](const auto& keep) { return std::none_of(pointer_, pointer_ + length_, keep); });
 	}
 
 	// 2.6.4 Return the pointer to the underlying data
@@ -151,103 +781,804 @@ namespace fsv {
 
 	// 2.6.5 Return the predicate used for filtering
 	auto filtered_string_view::predicate() const -> const filter& {
+		return predicate_.get();
+	}
+
+	// Return the handle owning the predicate, copying it shares the predicate without allocating
+	auto filtered_string_view::shared_predicate() const -> const predicate_handle& {
 		return predicate_;
 	}
 
+	auto filtered_string_view::owner() const noexcept -> const shared_buffer& {
+		return owner_;
+	}
+
+	auto filtered_string_view::memoized(std::size_t max_size) const -> filtered_string_view {
+		auto result = *this;
+		if (not memo_ or memo_->max_size != max_size) {
+			result.memo_ = detail::intrusive_ptr<detail::memo>(new detail::memo());
+			result.memo_->max_size = max_size;
+		}
+		return result;
+	}
+
+	auto filtered_string_view::is_memoized() const noexcept -> bool {
+		return static_cast<bool>(memo_);
+	}
+
+	auto filtered_string_view::filled_memo() const -> const detail::memo* {
+		if (not memo_) {
+			return nullptr;
+		}
+		if (not memo_->ready.load(std::memory_order_acquire)) {
+			// Concurrent first uses wait here while one of them materialises the view
+			std::call_once(memo_->once, [&] {
+				const auto max_size = memo_->max_size;
+				auto text = std::string();
+				auto size = std::size_t{0};
+				if (unfiltered() or steps_by_block(predicate_.state())) {
+					// Counting is cheap, so only copy results that will be kept, and copy them into exact storage
+					size = count_kept();
+					if (size <= max_size) {
+						text.reserve(size);
+						append_kept(text);
+					}
+				}
+				else {
+					// Gather runs until the result outgrows max_size, then free them and only count the rest
+					for_each_kept_run(predicate_.state(), pointer_, length_, [&](const char* run, std::size_t count) {
+						size += count;
+						if (size <= max_size) {
+							if (size > text.capacity()) { // Grow geometrically, but never past max_size
+								text.reserve(std::min(std::max(size, 2 * text.capacity()), max_size));
+							}
+							text.append(run, count);
+						}
+						else if (text.capacity() != 0) {
+							text = std::string();
+						}
+					});
+					text.shrink_to_fit();
+				}
+				memo_->size = size;
+				memo_->kept = size <= max_size;
+				memo_->text = std::move(text);
+				memo_->ready.store(true, std::memory_order_release);
+			});
+		}
+		return memo_.get();
+	}
+
+	// Whether every character is kept, allowing plain pointer arithmetic
+	auto filtered_string_view::unfiltered() const -> bool {
+		return predicate_.is_default();
+	}
+
 	// Return the length of the original string
 	auto filtered_string_view::original_size() const -> std::size_t {
 		return length_;
 	}
 
+	namespace {
+		// Compare characters the way std::string::compare does, as unsigned char
+		auto compare_chars(char lhs, char rhs) -> std::strong_ordering {
+			return static_cast<unsigned char>(lhs) <=> static_cast<unsigned char>(rhs);
+		}
+
+		// Walk two filtered ranges in step, comparing the kept characters without materialising either range
+		// Taking the predicates by reference lets compact views compare without copying their handles
+		auto compare_contents(std::string_view lhs,
+		                      const predicate_handle& lhs_pred,
+		                      std::string_view rhs,
+		                      const predicate_handle& rhs_pred) -> std::strong_ordering {
+			if (lhs_pred.is_default() and rhs_pred.is_default()) {
+				// Use the standard library's comparison functions and C++20's spaceship operator
+				return lhs.compare(rhs) <=> 0;
+			}
+
+			return with_predicate(lhs_pred.state(), [&](const auto& lhs_keep) {
+				return with_predicate(rhs_pred.state(), [&](const auto& rhs_keep) {
+					auto l = lhs.begin();
+					auto r = rhs.begin();
+					while (true) {
+						while (l != lhs.end() and not lhs_keep(*l)) {
+							++l;
+						}
+						while (r != rhs.end() and not rhs_keep(*r)) {
+							++r;
+						}
+						if (l == lhs.end() or r == rhs.end()) { // The shorter view orders first
+							return (l != lhs.end()) <=> (r != rhs.end());
+						}
+						if (const auto order = compare_chars(*l, *r); std::is_neq(order)) {
+							return order;
+						}
+						++l;
+						++r;
+					}
+				});
+			});
+		}
+	} // namespace
+
 	// 2.7.1. Overloading of ==, compares two fsv lexicographically for equality
 	auto operator==(const filtered_string_view& lhs, const filtered_string_view& rhs) -> bool {
-		return static_cast<std::string>(lhs) == static_cast<std::string>(rhs);
+		const auto lhs_sv = std::string_view(lhs.data(), lhs.original_size());
+		const auto rhs_sv = std::string_view(rhs.data(), rhs.original_size());
+		if (lhs.shared_predicate().is_default() and rhs.shared_predicate().is_default()) {
+			return lhs_sv == rhs_sv;
+		}
+		return std::is_eq(compare_contents(lhs_sv, lhs.shared_predicate(), rhs_sv, rhs.shared_predicate()));
 	}
 
 	// 2.7.2 Overloading of <=>
 	auto operator<=>(const filtered_string_view& lhs, const filtered_string_view& rhs) -> std::strong_ordering {
-		auto lhs_str = static_cast<std::string>(lhs); // Convert lhs to a string
-		auto rhs_str = static_cast<std::string>(rhs); // Convert rhs to a string
-
-		// Use the standard library's comparison functions and C++20's spaceship operator
-		return lhs_str.compare(rhs_str) <=> 0;
+		return compare_contents(std::string_view(lhs.data(), lhs.original_size()),
+		                        lhs.shared_predicate(),
+		                        std::string_view(rhs.data(), rhs.original_size()),
+		                        rhs.shared_predicate());
 	}
 
-	// 2.7.3 Overloading of <<
-	std::ostream& operator<<(std::ostream& os, const filtered_string_view& fsv) {
-		for (std::size_t i = 0; i < fsv.size(); ++i) {
-			os << fsv[static_cast<int>(i)]; // Output each filtered character
+	// Compact view
+	namespace {
+		// The 32-bit length of a compact_view over size characters
+		auto compact_length(std::size_t size) -> std::uint32_t {
+			if (size > std::numeric_limits<std::uint32_t>::max()) {
+				throw std::length_error("compact_view: the view is too long for a 32-bit length");
+			}
+			return static_cast<std::uint32_t>(size);
 		}
-		return os;
-	}
+	} // namespace
 
-	// 2.8 Non-Member Utility Functions
-	// 2.8.1 Compose
-	// Accept a fsv object and a vector of predicates and return a new fsv object
-	// Combine all filter predicates with and, and return true only when all predicates return true,
-	// that is, all filters will filter the same characters
-	// As long as one of the predicate functions is false,
-	// the new predicate function will short-circuit and immediately return false
-	auto compose(const filtered_string_view& fsv, const std::vector<filter>& filts) -> filtered_string_view {
-		auto composite_filter = [filts](const char& c) -> bool {
-			return std::ranges::all_of(filts, [&](const auto& filt) { return filt(c); });
-		};
+	compact_view::compact_view() noexcept
+	: pointer_(nullptr)
+	, length_(0)
+	, predicate_id_(0) {}
 
-		return filtered_string_view(fsv.data(), composite_filter);
+	compact_view::compact_view(const filtered_string_view& fsv)
+	: pointer_(fsv.data())
+	, length_(compact_length(fsv.original_size())) // Checked before interning, which cannot be undone
+	, predicate_id_(fsv.shared_predicate().id()) {}
+
+	compact_view::operator filtered_string_view() const {
+		return filtered_string_view(pointer_, length_, predicate_handle::from_id(predicate_id_));
 	}
 
-	// 2.8.2 Split
-	// Receive two fsv as parameters, one is fsv and the other is tok, and return a vector
-	// Using tok as the delimiter, cut fsv into a series of substrings and return them
-	// If tok is at the beginning or end of fsv, the result after splitting may contain an empty fsv
-	// If fsv does not contain tok, or fsv is empty, the returned vector contains a copy of fsv
-	// fsv::split() can accept an empty delimiter
-	auto split(const filtered_string_view& fsv, const filtered_string_view& tok) -> std::vector<filtered_string_view> {
-		std::vector<filtered_string_view> result;
+	auto compact_view::view() const -> filtered_string_view {
+		return static_cast<filtered_string_view>(*this);
+	}
 
-		// If fsv is empty or tok is empty, return a copy of fsv
-		if (fsv.empty() or tok.empty()) {
-			result.push_back(fsv);
-			return result;
-		}
+	auto compact_view::data() const noexcept -> const char* {
+		return pointer_;
+	}
 
-		const char* start = fsv.data(); // Pointer to the start of fsv
-		const char* end = start + fsv.original_size(); // Point to the end of fsv
-		const char* current = start; // Pointer used to traverse fsv
-		const char* tok_start = tok.data(); //  Pointer to the start of tok
-		const std::size_t tok_len = tok.size(); // The length of tok
+	auto compact_view::original_size() const noexcept -> std::size_t {
+		return length_;
+	}
 
-		while (current < end) {
-			// Find the position of the tok
-			const char* next = std::search(current, end, tok_start, tok_start + tok_len);
+	auto compact_view::predicate_id() const noexcept -> std::uint32_t {
+		return predicate_id_;
+	}
 
-			if (next == end) { // If fsv does not contain tok
-				if (current != end) {
-					// Create a new null-terminated fsv
-					std::size_t len = static_cast<size_t>(end - current);
-					char* temp = new char[len + 1];
-					std::strncpy(temp, current, len);
-					temp[len] = '\0';
-					result.emplace_back(temp, fsv.predicate());
-				}
-				break;
-			}
-			else {
-				// Create a new null-terminated fsv
-				std::size_t len = static_cast<size_t>(next - current);
-				char* temp = new char[len + 1];
-				std::strncpy(temp, current, len);
-				temp[len] = '\0';
-				result.emplace_back(temp, fsv.predicate());
-				current = next + tok_len; // Update current, skipping the currently found tok
-			}
+	auto operator==(const compact_view& lhs, const compact_view& rhs) -> bool {
+		const auto lhs_sv = std::string_view(lhs.data(), lhs.original_size());
+		const auto rhs_sv = std::string_view(rhs.data(), rhs.original_size());
+		if (lhs.predicate_id() == 0 and rhs.predicate_id() == 0) { // Both unfiltered, no registry lookup needed
+			return lhs_sv == rhs_sv;
+		}
+		return std::is_eq(compare_contents(lhs_sv,
+		                                   predicate_handle::from_id(lhs.predicate_id()),
+		                                   rhs_sv,
+		                                   predicate_handle::from_id(rhs.predicate_id())));
+	}
+
+	auto operator<=>(const compact_view& lhs, const compact_view& rhs) -> std::strong_ordering {
+		if (lhs.predicate_id() == 0 and rhs.predicate_id() == 0) {
+			return std::string_view(lhs.data(), lhs.original_size())
+			           .compare(std::string_view(rhs.data(), rhs.original_size()))
+			       <=> 0;
+		}
+		return compare_contents(std::string_view(lhs.data(), lhs.original_size()),
+		                        predicate_handle::from_id(lhs.predicate_id()),
+		                        std::string_view(rhs.data(), rhs.original_size()),
+		                        predicate_handle::from_id(rhs.predicate_id()));
+	}
+
+	// Indexed view
+	indexed_view::indexed_view()
+	: view_()
+	, positions_(std::make_shared<const std::vector<std::size_t>>()) {}
+
+	indexed_view::indexed_view(const filtered_string_view& fsv)
+	: view_(fsv)
+	, positions_() {
+		auto positions = std::vector<std::size_t>();
+		for (auto it = fsv.begin(); it != fsv.end(); ++it) {
+			positions.push_back(static_cast<std::size_t>(&*it - fsv.data()));
+		}
+		positions.shrink_to_fit();
+		positions_ = std::make_shared<const std::vector<std::size_t>>(std::move(positions));
+	}
+
+	auto indexed_view::operator[](int n) const -> const char& {
+		return view_.data()[(*positions_)[static_cast<std::size_t>(n)]];
+	}
+
+	auto indexed_view::at(int index) const -> const char& {
+		if (index < 0 or static_cast<std::size_t>(index) >= positions_->size()) {
+			std::ostringstream oss;
+			oss << "filtered_string_view::at(" << index << "): invalid index";
+			throw std::domain_error(oss.str());
+		}
+		return (*this)[index];
+	}
+
+	auto indexed_view::size() const noexcept -> std::size_t {
+		return positions_->size();
+	}
+
+	auto indexed_view::empty() const noexcept -> bool {
+		return positions_->empty();
+	}
+
+	auto indexed_view::position(std::size_t n) const -> std::size_t {
+		return positions_->at(n);
+	}
+
+	auto indexed_view::view() const noexcept -> const filtered_string_view& {
+		return view_;
+	}
+
+	auto indexed_view::begin() const noexcept -> const_iterator {
+		return const_iterator(view_.data(), positions_->data());
+	}
+
+	auto indexed_view::cbegin() const noexcept -> const_iterator {
+		return begin();
+	}
+
+	auto indexed_view::end() const noexcept -> const_iterator {
+		return const_iterator(view_.data(), positions_->data() + positions_->size());
+	}
+
+	auto indexed_view::cend() const noexcept -> const_iterator {
+		return end();
+	}
+
+	auto indexed_view::rbegin() const noexcept -> const_reverse_iterator {
+		return const_reverse_iterator(end());
+	}
+
+	auto indexed_view::crbegin() const noexcept -> const_reverse_iterator {
+		return rbegin();
+	}
+
+	auto indexed_view::rend() const noexcept -> const_reverse_iterator {
+		return const_reverse_iterator(begin());
+	}
+
+	auto indexed_view::crend() const noexcept -> const_reverse_iterator {
+		return rend();
+	}
+
+	auto indexed(const filtered_string_view& fsv) -> indexed_view {
+		return indexed_view(fsv);
+	}
+
+	// Growing view
+	growing_view::growing_view()
+	: growing_view(predicate_handle()) {}
+
+	growing_view::growing_view(filter predicate, bool indexed)
+	: growing_view(predicate_handle(std::move(predicate)), indexed) {}
+
+	growing_view::growing_view(predicate_handle predicate, bool indexed)
+	: pointer_(nullptr)
+	, length_(0)
+	, predicate_(std::move(predicate))
+	, count_(0)
+	, indexed_(indexed)
+	, positions_() {}
+
+	auto growing_view::extend(const char* data, std::size_t length) -> std::size_t {
+		if (length < length_) {
+			throw std::invalid_argument("growing_view::extend: the buffer is shorter than before");
+		}
+		// Only the new suffix is filtered, through a view so it gets the same fast paths
+		const auto suffix = filtered_string_view(data + length_, length - length_, predicate_);
+		if (indexed_) {
+			for (auto it = suffix.begin(); it != suffix.end(); ++it) {
+				positions_.push_back(static_cast<std::size_t>(&*it - data));
+			}
+			count_ = positions_.size();
+		}
+		else {
+			count_ += suffix.size();
+		}
+		pointer_ = data;
+		length_ = length;
+		return count_;
+	}
+
+	auto growing_view::extend(std::string_view buffer) -> std::size_t {
+		return extend(buffer.data(), buffer.size());
+	}
+
+	auto growing_view::size() const noexcept -> std::size_t {
+		return count_;
+	}
+
+	auto growing_view::empty() const noexcept -> bool {
+		return count_ == 0;
+	}
+
+	auto growing_view::original_size() const noexcept -> std::size_t {
+		return length_;
+	}
+
+	auto growing_view::is_indexed() const noexcept -> bool {
+		return indexed_;
+	}
+
+	auto growing_view::operator[](int n) const -> const char& {
+		if (indexed_ and n >= 0 and static_cast<std::size_t>(n) < count_) {
+			return pointer_[positions_[static_cast<std::size_t>(n)]];
+		}
+		return view()[n];
+	}
+
+	auto growing_view::position(std::size_t n) const -> std::size_t {
+		if (not indexed_) {
+			throw std::logic_error("growing_view::position: the view is not indexed");
+		}
+		return positions_.at(n);
+	}
+
+	auto growing_view::view() const -> filtered_string_view {
+		return filtered_string_view(pointer_, length_, predicate_);
+	}
+
+	namespace {
+		// The size class of a request of n bytes, n <= string_pool::max_chunk
+		auto size_class(std::size_t n) -> std::size_t {
+			return static_cast<std::size_t>(std::bit_width((std::max(n, std::size_t{1}) - 1) / string_pool::min_chunk));
+		}
+
+		auto chunk_size(std::size_t size_class) -> std::size_t {
+			return string_pool::min_chunk << size_class;
+		}
+	} // namespace
+
+	auto string_pool::shared() -> string_pool& {
+		// Never destroyed, so strings in static storage can outlive it safely
+		static auto* const pool = new string_pool();
+		return *pool;
+	}
+
+	auto string_pool::allocate(std::size_t n) -> char* {
+		if (n > max_chunk) {
+			return new char[n];
+		}
+
+		const auto cls = size_class(n);
+		const auto size = chunk_size(cls);
+		const auto lock = std::lock_guard<std::mutex>(mutex_);
+		if (auto* chunk = free_[cls]) {
+			std::memcpy(static_cast<void*>(&free_[cls]), chunk, sizeof(char*));
+			free_bytes_ -= size;
+			return chunk;
+		}
+
+		if (static_cast<std::size_t>(slab_end_ - cursor_) < size) {
+			// Hand what is left of the current slab to the free lists, largest chunks first
+			while (static_cast<std::size_t>(slab_end_ - cursor_) >= min_chunk) {
+				const auto left = static_cast<std::size_t>(slab_end_ - cursor_);
+				const auto fit = static_cast<std::size_t>(std::bit_width(left / min_chunk)) - 1;
+				push_free(cursor_, fit);
+				cursor_ += chunk_size(fit);
+			}
+			slabs_.push_back(std::make_unique<char[]>(slab_size));
+			cursor_ = slabs_.back().get();
+			slab_end_ = cursor_ + slab_size;
+		}
+		auto* chunk = cursor_;
+		cursor_ += size;
+		return chunk;
+	}
+
+	auto string_pool::deallocate(char* p, std::size_t n) noexcept -> void {
+		if (p == nullptr) {
+			return;
+		}
+		if (n > max_chunk) {
+			delete[] p;
+			return;
+		}
+		const auto lock = std::lock_guard<std::mutex>(mutex_);
+		push_free(p, size_class(n));
+	}
+
+	auto string_pool::push_free(char* chunk, std::size_t size_class) noexcept -> void {
+		std::memcpy(chunk, static_cast<const void*>(&free_[size_class]), sizeof(char*));
+		free_[size_class] = chunk;
+		free_bytes_ += chunk_size(size_class);
+	}
+
+	auto string_pool::slab_bytes() const -> std::size_t {
+		const auto lock = std::lock_guard<std::mutex>(mutex_);
+		return slabs_.size() * slab_size;
+	}
+
+	auto string_pool::free_bytes() const -> std::size_t {
+		const auto lock = std::lock_guard<std::mutex>(mutex_);
+		return free_bytes_;
+	}
+
+	filtered_string::filtered_string() noexcept
+	: pool_(nullptr)
+	, data_(nullptr)
+	, size_(0) {}
+
+	filtered_string::filtered_string(const filtered_string_view& fsv, string_pool& pool)
+	: filtered_string() {
+		const auto& state = fsv.shared_predicate().state();
+		if (state.kind == detail::predicate_kind::identity or steps_by_block(state)) {
+			// Counting first is cheap, so copy straight into storage of the right size
+			size_ = fsv.size();
+			if (size_ != 0) {
+				data_ = pool.allocate(size_ + 1);
+				fsv.copy_to(data_, size_);
+			}
+		}
+		else {
+			// Call a generic predicate only once, gathering into pool storage big enough for every character and
+			// moving the result into storage of the right size when it needs a smaller chunk. Scratch storage goes
+			// back to the pool, so repeated copies reuse it, and a predicate may copy views itself
+			const auto capacity = fsv.original_size() + 1;
+			auto* scratch = pool.allocate(capacity);
+			size_ = fsv.copy_to(scratch, capacity - 1);
+			const auto same_chunk = size_ + 1 == capacity
+			                        or (capacity <= string_pool::max_chunk
+			                            and size_class(size_ + 1) == size_class(capacity));
+			if (size_ != 0 and same_chunk) { // Freeing by the result's size returns the chunk to the same list
+				data_ = scratch;
+			}
+			else {
+				if (size_ != 0) {
+					data_ = pool.allocate(size_ + 1);
+					std::memcpy(data_, scratch, size_);
+				}
+				pool.deallocate(scratch, capacity);
+			}
+		}
+		if (data_ != nullptr) {
+			data_[size_] = '\0';
+			pool_ = &pool;
+		}
+	}
+
+	filtered_string::filtered_string(const filtered_string& other)
+	: filtered_string() {
+		if (other.data_ != nullptr) {
+			data_ = other.pool_->allocate(other.size_ + 1);
+			std::memcpy(data_, other.data_, other.size_ + 1);
+			size_ = other.size_;
+			pool_ = other.pool_;
+		}
+	}
+
+	filtered_string::filtered_string(filtered_string&& other) noexcept
+	: pool_(std::exchange(other.pool_, nullptr))
+	, data_(std::exchange(other.data_, nullptr))
+	, size_(std::exchange(other.size_, 0)) {}
+
+	auto filtered_string::operator=(const filtered_string& other) -> filtered_string& {
+		if (this != &other) {
+			*this = filtered_string(other);
+		}
+		return *this;
+	}
+
+	auto filtered_string::operator=(filtered_string&& other) noexcept -> filtered_string& {
+		std::swap(pool_, other.pool_);
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+		return *this;
+	}
+
+	filtered_string::~filtered_string() {
+		if (data_ != nullptr) {
+			pool_->deallocate(data_, size_ + 1);
+		}
+	}
+
+	auto filtered_string::size() const noexcept -> std::size_t {
+		return size_;
+	}
+
+	auto filtered_string::empty() const noexcept -> bool {
+		return size_ == 0;
+	}
+
+	auto filtered_string::data() const noexcept -> const char* {
+		return data_ != nullptr ? data_ : "";
+	}
+
+	auto filtered_string::operator[](int n) const -> const char& {
+		return data()[n];
+	}
+
+	auto filtered_string::begin() const noexcept -> const char* {
+		return data();
+	}
+
+	auto filtered_string::end() const noexcept -> const char* {
+		return data() + size_;
+	}
+
+	auto filtered_string::view() const -> filtered_string_view {
+		return filtered_string_view(data(), size_);
+	}
+
+	auto operator==(const filtered_string& lhs, const filtered_string& rhs) noexcept -> bool {
+		return std::string_view(lhs.data(), lhs.size()) == std::string_view(rhs.data(), rhs.size());
+	}
+
+	// 2.7.3 Overloading of <<
+	std::ostream& operator<<(std::ostream& os, const filtered_string_view& fsv) {
+		// Write whole runs of kept characters, the entire range in one call when nothing is filtered
+		const auto& state = fsv.shared_predicate().state();
+		for_each_kept_run(state, fsv.data(), fsv.original_size(), [&](const char* run, std::size_t count) {
+			os.write(run, static_cast<std::streamsize>(count));
+		});
+		return os;
+	}
+
+	namespace {
+		// Gathers runs of characters into iovec arrays and writes them with as few writev calls as possible
+		class run_writer {
+		 public:
+			explicit run_writer(int fd)
+			: fd_(fd)
+			, runs_()
+			, size_(0)
+			, written_(0) {}
+
+			auto add(const char* run, std::size_t count) -> void {
+				// writev does not modify the buffers, the iovec type just has no const member
+				runs_[size_++] = ::iovec{const_cast<char*>(run), count};
+				if (size_ == runs_.size()) {
+					flush();
+				}
+			}
+
+			// Write every pending run, resuming after partial writes and interrupted calls
+			auto flush() -> void {
+				auto* first = runs_.data();
+				auto* last = runs_.data() + size_;
+				while (first != last) {
+					const auto result = ::writev(fd_, first, static_cast<int>(last - first));
+					if (result < 0) {
+						if (errno == EINTR) {
+							continue;
+						}
+						throw std::system_error(errno, std::generic_category(), "fsv::write_to: writev failed");
+					}
+					auto done = static_cast<std::size_t>(result);
+					written_ += done;
+					while (first != last and done >= first->iov_len) { // Skip the runs written in full
+						done -= first->iov_len;
+						++first;
+					}
+					if (first != last) { // Resume in the middle of a partially written run
+						first->iov_base = static_cast<char*>(first->iov_base) + done;
+						first->iov_len -= done;
+					}
+				}
+				size_ = 0;
+			}
+
+			auto written() const -> std::size_t {
+				return written_;
+			}
+
+		 private:
+			// Enough runs per call to amortise the system call, while keeping the array on the stack
+			static constexpr auto max_runs = std::min(std::size_t{IOV_MAX}, std::size_t{512});
+
+			int fd_;
+			std::array<::iovec, max_runs> runs_;
+			std::size_t size_; // Number of pending runs
+			std::size_t written_;
+		};
+	} // namespace
+
+	auto write_to(int fd, const filtered_string_view& fsv) -> std::size_t {
+		return write_to(fd, std::span<const filtered_string_view>(&fsv, 1));
+	}
+
+	auto write_to(int fd, std::span<const filtered_string_view> views) -> std::size_t {
+		auto writer = run_writer(fd);
+		for (const auto& fsv : views) {
+			for_each_kept_run(fsv.shared_predicate().state(),
+			                  fsv.data(),
+			                  fsv.original_size(),
+			                  [&](const char* run, std::size_t count) { writer.add(run, count); });
+		}
+		writer.flush();
+		return writer.written();
+	}
+
+	// 2.8 Non-Member Utility Functions
+	namespace {
+		// Run each filter over the first sample_size characters of data, timing it and counting what it rejects,
+		// and return the filter positions sorted by cost / rejection rate. Filters that never reject go last
+		auto sample_filter_order(const std::vector<filter>& filters, const char* data, std::size_t sample_size)
+		    -> std::vector<std::size_t> {
+			auto order = std::vector<std::size_t>(filters.size());
+			std::iota(order.begin(), order.end(), std::size_t{0});
+			if (sample_size == 0) {
+				return order;
+			}
+
+			auto rank = std::vector<double>(filters.size());
+			for (std::size_t i = 0; i < filters.size(); ++i) {
+				auto rejected = std::size_t{0};
+				const auto start = std::chrono::steady_clock::now();
+				for (const char* c = data; c != data + sample_size; ++c) {
+					rejected += filters[i](*c) ? 0U : 1U;
+				}
+				const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+				rank[i] = rejected == 0 ? std::numeric_limits<double>::infinity()
+				                        : std::max(elapsed.count(), 1.0) / static_cast<double>(rejected);
+			}
+
+			std::ranges::stable_sort(order, [&](std::size_t lhs, std::size_t rhs) { return rank[lhs] < rank[rhs]; });
+			return order;
+		}
+	} // namespace
+
+	// 2.8.1 Compose
+	// Accept a fsv object and a vector of predicates and return a new fsv object
+	// Combine all filter predicates with and, and return true only when all predicates return true,
+	// that is, all filters will filter the same characters
+	// As long as one of the predicate functions is false,
+	// the new predicate function will short-circuit and immediately return false
+	// Nested compositions are flattened and every byte_class is folded into one table, so composing byte classes
+	// costs a single lookup per character however deep the composition goes
+	// In adaptive mode the filters that are not byte classes are first run over a sample of the view, then evaluated
+	// cheapest-per-rejection first, which minimises the expected cost per character for independent filters
+	auto compose(const filtered_string_view& fsv, const std::vector<filter>& filts, const compose_options& options)
+	    -> filtered_string_view {
+		auto classes = byte_class::all();
+		auto filters = std::vector<filter>();
+
+		for (const auto& filt : filts) {
+			if (const auto* cls = filt.target<byte_class>()) {
+				classes = classes & *cls;
+			}
+			else if (const auto* composed = filt.target<detail::composed_filter>()) { // Splice in its parts
+				classes = classes & composed->classes;
+				filters.insert(filters.end(), composed->filters->begin(), composed->filters->end());
+			}
+			else if (not is_default_function(filt)) { // The default predicate keeps everything, so drop it
+				filters.push_back(filt);
+			}
+		}
+
+		if (filters.empty()) { // Only byte classes were given, the table alone is the composite filter
+			if (classes == byte_class::all()) {
+				return filtered_string_view(fsv.data(), fsv.original_size(), predicate_handle(), fsv.owner());
+			}
+			return filtered_string_view(fsv.data(), fsv.original_size(), predicate_handle(classes), fsv.owner());
+		}
+		if (filters.size() == 1 and classes == byte_class::all()) { // Nothing to compose
+			return filtered_string_view(fsv.data(),
+			                            fsv.original_size(),
+			                            predicate_handle(std::move(filters.front())),
+			                            fsv.owner());
+		}
+
+		auto order = std::vector<std::size_t>(filters.size());
+		std::iota(order.begin(), order.end(), std::size_t{0});
+		if (options.adaptive) {
+			order = sample_filter_order(filters, fsv.data(), std::min(options.sample_size, fsv.original_size()));
+			auto ordered = std::vector<filter>();
+			ordered.reserve(filters.size());
+			for (const auto i : order) {
+				ordered.push_back(std::move(filters[i]));
+			}
+			filters = std::move(ordered);
+		}
+
+		auto composite_filter =
+		    detail::composed_filter{classes,
+		                            std::make_shared<const std::vector<filter>>(std::move(filters)),
+		                            std::make_shared<const std::vector<std::size_t>>(std::move(order))};
+		return filtered_string_view(fsv.data(), fsv.original_size(), predicate_handle(composite_filter), fsv.owner());
+	}
+
+	auto composed_order(const filtered_string_view& fsv) -> std::vector<std::size_t> {
+		if (const auto* composed = fsv.predicate().target<detail::composed_filter>()) {
+			return *composed->order;
+		}
+		return {};
+	}
+
+	auto detail::composed_filter::operator()(const char& c) const -> bool {
+		return classes.contains(c) and std::ranges::all_of(*filters, [&](const auto& filt) { return filt(c); });
+	}
+
+	// 2.8.2 Split
+	// Receive two fsv as parameters, one is fsv and the other is tok, and return a vector
+	// Using tok as the delimiter, cut fsv into a series of substrings and return them
+	// If tok is at the beginning or end of fsv, the result after splitting may contain an empty fsv
+	// If fsv does not contain tok, or fsv is empty, the returned vector contains a copy of fsv
+	// fsv::split() can accept an empty delimiter
+	auto detail::visit_split_pieces(const filtered_string_view& fsv,
+	                                const filtered_string_view& tok,
+	                                run_callback fn,
+	                                void* context) -> void {
+		// If fsv is empty or tok is empty, the only piece is a copy of fsv
+		if (fsv.empty() or tok.empty()) {
+			fn(context, fsv.data(), fsv.original_size());
+			return;
+		}
+
+		const char* start = fsv.data(); // Pointer to the start of fsv
+		const char* end = start + fsv.original_size(); // Point to the end of fsv
+		const char* current = start; // Pointer used to traverse fsv
+		const char* tok_start = tok.data(); //  Pointer to the start of tok
+		const std::size_t tok_len = tok.size(); // The length of tok
+
+		// Each piece views its span of the original data directly, sharing fsv's predicate
+		while (current < end) {
+			// Find the position of the tok
+			const char* next = std::search(current, end, tok_start, tok_start + tok_len);
+
+			if (next == end) { // If fsv does not contain tok
+				if (current != end) {
+					fn(context, current, static_cast<std::size_t>(end - current));
+				}
+				break;
+			}
+			else {
+				fn(context, current, static_cast<std::size_t>(next - current));
+				current = next + tok_len; // Update current, skipping the currently found tok
+			}
 		}
 
 		// If fsv ends with tok
 		if (current == end and end != start and *(end - tok_len) == *tok_start) {
-			result.emplace_back("", fsv.predicate());
+			fn(context, end, 0);
 		}
-		return result;
+	}
+
+	auto split(const filtered_string_view& fsv, const filtered_string_view& tok) -> std::vector<filtered_string_view> {
+		return split(fsv, tok, std::allocator<filtered_string_view>());
+	}
+
+	auto detail::visit_kept_runs(const filtered_string_view& fsv, run_callback fn, void* context) -> void {
+		for_each_kept_run(fsv.shared_predicate().state(),
+		                  fsv.data(),
+		                  fsv.original_size(),
+		                  [&](const char* run, std::size_t count) { fn(context, run, count); });
+	}
+
+	auto detail::materialized_capacity(const filtered_string_view& fsv) -> std::size_t {
+		// A generic predicate would be called twice if the view were counted first
+		return steps_by_block(fsv.shared_predicate().state()) ? fsv.size() : fsv.original_size();
+	}
+
+	auto pmr::to_string(const filtered_string_view& fsv, std::pmr::memory_resource* resource) -> std::pmr::string {
+		return fsv::to_string(fsv, std::pmr::polymorphic_allocator<char>(resource));
+	}
+
+	auto pmr::split(const filtered_string_view& fsv,
+	                const filtered_string_view& tok,
+	                std::pmr::memory_resource* resource) -> std::pmr::vector<filtered_string_view> {
+		return fsv::split(fsv, tok, std::pmr::polymorphic_allocator<filtered_string_view>(resource));
 	}
 
 	// 2.8.3 substr
@@ -262,23 +1593,25 @@ namespace fsv {
 
 		// Make sure pos does not exceed the length of the filtered string
 		if (pos >= static_cast<int>(fsv.size())) {
-			return filtered_string_view("", fsv.predicate());
+			return filtered_string_view(end, 0, fsv.shared_predicate(), fsv.owner());
 		}
 
 		// Find the starting position of a substring
 		int filtered_pos = 0;
 		const char* substr_start = nullptr;
 
-		while (current != end and filtered_pos < pos) {
-			if (fsv.predicate()(*current)) {
-				++filtered_pos;
+		with_predicate(fsv.shared_predicate().state(), [&](const auto& keep) {
+			while (current != end and filtered_pos < pos) {
+				if (keep(*current)) {
+					++filtered_pos;
+				}
+				++current;
 			}
-			++current;
-		}
+		});
 
 		// Make sure you find your starting position
 		if (current == end) {
-			return filtered_string_view("", fsv.predicate());
+			return filtered_string_view(end, 0, fsv.shared_predicate(), fsv.owner());
 		}
 
 		substr_start = current;
@@ -287,47 +1620,626 @@ namespace fsv {
 		int filtered_count = 0;
 		const char* substr_end = nullptr;
 
-		while (current != end and (count <= 0 or filtered_count < count)) {
-			if (fsv.predicate()(*current)) {
-				++filtered_count;
+		with_predicate(fsv.shared_predicate().state(), [&](const auto& keep) {
+			while (current != end and (count <= 0 or filtered_count < count)) {
+				if (keep(*current)) {
+					++filtered_count;
+				}
+				++current;
 			}
-			++current;
-		}
+		});
 
 		substr_end = current;
 
-		// Creates a new null-terminated fsv
-		std::size_t len = static_cast<size_t>(substr_end - substr_start);
-		char* temp = new char[len + 1];
-		std::strncpy(temp, substr_start, len);
-		temp[len] = '\0';
+		// View the span of the original data directly, no copy is needed
+		return filtered_string_view(substr_start,
+		                            static_cast<std::size_t>(substr_end - substr_start),
+		                            fsv.shared_predicate(),
+		                            fsv.owner());
+	}
+
+	// Bitmask views
+	namespace detail {
+		auto bitmask::offset_of(const char* p) const noexcept -> std::size_t {
+			return offset_from(base, p);
+		}
+
+		auto bitmask::contains(const char& c) const noexcept -> bool {
+			const auto offset = offset_of(&c);
+			return offset < length and ((words[offset / 64] >> (offset % 64)) & 1) != 0;
+		}
+
+		auto bitmask::operator()(const char& c) const noexcept -> bool {
+			return contains(c);
+		}
+
+		auto bitmask::bits(std::size_t offset, std::size_t n) const noexcept -> std::uint64_t {
+			if (n == 0) {
+				return 0;
+			}
+			const auto word = offset / 64;
+			const auto shift = offset % 64;
+			auto result = words[word] >> shift;
+			if (shift != 0 and shift + n > 64) { // The bits straddle two words
+				result |= words[word + 1] << (64 - shift);
+			}
+			return n == 64 ? result : result & ((std::uint64_t{1} << n) - 1);
+		}
+
+		auto mask_filter::operator()(const char& c) const -> bool {
+			return mask->contains(c);
+		}
+	} // namespace detail
+
+	namespace {
+		// The selection of fsv as words aligned to fsv.data(), shared when fsv already is a bitmask view of its range
+		auto selection_of(const filtered_string_view& fsv) -> std::shared_ptr<const detail::bitmask> {
+			const auto& state = fsv.shared_predicate().state();
+			if (state.kind == detail::predicate_kind::mask and state.mask->base == fsv.data()
+			    and state.mask->length == fsv.original_size())
+			{
+				return state.mask;
+			}
+			const auto length = fsv.original_size();
+			auto words = std::vector<std::uint64_t>((length + 63) / 64);
+			for (std::size_t w = 0; w < words.size(); ++w) {
+				words[w] = block_mask(state, fsv.data() + w * 64, std::min(std::size_t{64}, length - w * 64));
+			}
+			return std::make_shared<const detail::bitmask>(detail::bitmask{fsv.data(), length, std::move(words)});
+		}
+
+		auto bitmask_view(std::shared_ptr<const detail::bitmask> mask, shared_buffer owner) -> filtered_string_view {
+			const auto* base = mask->base;
+			const auto length = mask->length;
+			return filtered_string_view(base,
+			                            length,
+			                            predicate_handle(detail::mask_filter{std::move(mask)}),
+			                            std::move(owner));
+		}
+
+		// Combine the selections of two views over the same characters one word at a time
+		template<typename Op>
+		auto combine(const char* name, const filtered_string_view& lhs, const filtered_string_view& rhs, Op op)
+		    -> filtered_string_view {
+			if (lhs.data() != rhs.data() or lhs.original_size() != rhs.original_size()) {
+				throw std::invalid_argument(std::string(name) + ": the views must cover the same characters");
+			}
+			const auto lhs_mask = selection_of(lhs);
+			const auto rhs_mask = selection_of(rhs);
+			auto words = std::vector<std::uint64_t>(lhs_mask->words.size());
+			std::transform(lhs_mask->words.begin(), lhs_mask->words.end(), rhs_mask->words.begin(), words.begin(), op);
+			auto mask = detail::bitmask{lhs.data(), lhs.original_size(), std::move(words)};
+			const auto& owner = lhs.owner() ? lhs.owner() : rhs.owner();
+			return bitmask_view(std::make_shared<const detail::bitmask>(std::move(mask)), owner);
+		}
+	} // namespace
+
+	auto masked(const filtered_string_view& fsv) -> filtered_string_view {
+		return bitmask_view(selection_of(fsv), fsv.owner());
+	}
+
+	auto mask_and(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view {
+		return combine("mask_and", lhs, rhs, std::bit_and<std::uint64_t>());
+	}
+
+	auto mask_or(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view {
+		return combine("mask_or", lhs, rhs, std::bit_or<std::uint64_t>());
+	}
+
+	auto mask_xor(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view {
+		return combine("mask_xor", lhs, rhs, std::bit_xor<std::uint64_t>());
+	}
+
+	auto mask_not(const filtered_string_view& fsv) -> filtered_string_view {
+		const auto selection = selection_of(fsv);
+		auto mask = std::make_shared<detail::bitmask>(*selection);
+		std::transform(mask->words.begin(), mask->words.end(), mask->words.begin(), std::bit_not<std::uint64_t>());
+		if (mask->length % 64 != 0) { // Bits past the end of the range stay clear
+			mask->words.back() &= (std::uint64_t{1} << (mask->length % 64)) - 1;
+		}
+		return bitmask_view(std::move(mask), fsv.owner());
+	}
+
+	// Batch filtering and multi-filter scans
+	namespace {
+		// Columns smaller than this per thread are not worth starting a thread for
+		constexpr auto min_bytes_per_thread = std::size_t{1} << 16;
+
+		auto batch_threads(const batch_options& options, std::size_t bytes) -> std::size_t {
+			const auto wanted =
+			    options.threads != 0 ? options.threads : std::size_t{std::thread::hardware_concurrency()};
+			return std::clamp(bytes / min_bytes_per_thread, std::size_t{1}, std::max(wanted, std::size_t{1}));
+		}
+
+		// Split [0, count) into parts contiguous ranges and call fn(first, last) on each, the last one on this thread
+		// The first exception thrown by any part is rethrown once every part has finished
+		template<typename F>
+		auto parallel_for(std::size_t count, std::size_t parts, const F& fn) -> void {
+			parts = std::clamp(parts, std::size_t{1}, std::max(count, std::size_t{1}));
+			auto errors = std::vector<std::exception_ptr>(parts);
+			auto run = [&](std::size_t part, std::size_t first, std::size_t last) {
+				try {
+					fn(first, last);
+				} catch (...) {
+					errors[part] = std::current_exception();
+				}
+			};
+
+			auto threads = std::vector<std::thread>();
+			threads.reserve(parts - 1);
+			auto first = std::size_t{0};
+			for (std::size_t part = 0; part < parts; ++part) {
+				const auto last = first + count / parts + (part < count % parts ? 1 : 0);
+				if (part + 1 == parts) {
+					run(part, first, last);
+				}
+				else {
+					threads.emplace_back(run, part, first, last);
+				}
+				first = last;
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			for (const auto& error : errors) {
+				if (error) {
+					std::rethrow_exception(error);
+				}
+			}
+		}
+	} // namespace
+
+	// Byte classes only need a byte histogram to be counted: one increment per byte, however many classes there are.
+	// That beats the scalar and SSE2 kernels but not the nibble lookup, which classifies a whole block in a few
+	// instructions, so with those every filter tests each 64-byte block in turn
+	auto scan(std::string_view data, const std::vector<filter>& filts, const scan_options& options) -> scan_result {
+		auto predicates = std::vector<predicate_handle>(filts.begin(), filts.end());
+		const auto blocks = (data.size() + 63) / 64;
+		const auto per_block = options.masks or options.strings or active_simd_level() >= simd_level::sse42;
+		const auto histogram_only = [&](const predicate_handle& predicate) {
+			const auto kind = predicate.state().kind;
+			return not per_block
+			       and (kind == detail::predicate_kind::identity or kind == detail::predicate_kind::table);
+		};
+		const auto use_histogram = std::any_of(predicates.begin(), predicates.end(), histogram_only);
+
+		auto result = scan_result{std::vector<std::size_t>(predicates.size()), {}, {}};
+		if (options.masks) {
+			result.masks.assign(predicates.size(), std::vector<std::uint64_t>(blocks));
+		}
+		if (options.strings) {
+			result.strings.resize(predicates.size());
+		}
+
+		auto histogram = std::array<std::size_t, 256>();
+		for (std::size_t b = 0; b < blocks; ++b) {
+			const char* block = data.data() + b * 64;
+			const auto n = std::min(std::size_t{64}, data.size() - b * 64);
+			if (use_histogram) {
+				for (std::size_t k = 0; k < n; ++k) {
+					++histogram[static_cast<unsigned char>(block[k])];
+				}
+			}
+			for (std::size_t i = 0; i < predicates.size(); ++i) {
+				if (histogram_only(predicates[i])) {
+					continue;
+				}
+				const auto mask = block_mask(predicates[i].state(), block, n);
+				result.counts[i] += static_cast<std::size_t>(std::popcount(mask));
+				if (options.masks) {
+					result.masks[i][b] = mask;
+				}
+				if (options.strings) {
+					for (auto bits = mask; bits != 0; bits &= bits - 1) {
+						result.strings[i].push_back(block[std::countr_zero(bits)]);
+					}
+				}
+			}
+		}
+
+		for (std::size_t i = 0; i < predicates.size(); ++i) {
+			if (histogram_only(predicates[i])) {
+				const auto& table = predicates[i].state().table;
+				for (std::size_t value = 0; value < histogram.size(); ++value) {
+					result.counts[i] += table.contains(static_cast<char>(value)) ? histogram[value] : 0;
+				}
+			}
+		}
+		return result;
+	}
+
+	auto filtered_column::rows() const noexcept -> std::size_t {
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
 
-		return filtered_string_view(temp, fsv.predicate());
+	auto filtered_column::operator[](std::size_t row) const -> std::string_view {
+		return std::string_view(data).substr(offsets[row], offsets[row + 1] - offsets[row]);
+	}
+
+	// Rows are contiguous, so the whole column is filtered as one stream: a first pass records the keep mask of every
+	// 64-byte block, the output offsets are the kept counts (ranks) at the row boundaries, and a second pass copies
+	// the kept characters straight out of the masks without testing them again
+	auto filter_column(const string_column& column, const predicate_handle& predicate, const batch_options& options)
+	    -> filtered_column {
+		const auto& offsets = column.offsets;
+		auto result = filtered_column();
+		if (offsets.empty()) {
+			result.offsets.push_back(0);
+			return result;
+		}
+		if (offsets.back() > column.data.size()
+		    or std::adjacent_find(offsets.begin(), offsets.end(), std::greater<>()) != offsets.end())
+		{
+			throw std::out_of_range("filter_column: offsets must be non-decreasing and within the data");
+		}
+
+		const auto& state = predicate.state();
+		const char* first = column.data.data() + offsets.front();
+		const auto bytes = offsets.back() - offsets.front();
+		const auto blocks = (bytes + 63) / 64;
+		const auto threads = batch_threads(options, bytes);
+
+		auto masks = std::vector<std::uint64_t>(blocks);
+		auto ranks = std::vector<std::size_t>(blocks + 1); // ranks[b] is the number of kept characters before block b
+		parallel_for(blocks, threads, [&](std::size_t b0, std::size_t b1) {
+			for (auto b = b0; b < b1; ++b) {
+				masks[b] = block_mask(state, first + b * 64, std::min(std::size_t{64}, bytes - b * 64));
+				ranks[b + 1] = static_cast<std::size_t>(std::popcount(masks[b]));
+			}
+		});
+		std::partial_sum(ranks.begin(), ranks.end(), ranks.begin());
+
+		result.offsets.resize(offsets.size());
+		parallel_for(offsets.size(), threads, [&](std::size_t r0, std::size_t r1) {
+			for (auto r = r0; r < r1; ++r) {
+				const auto pos = offsets[r] - offsets.front();
+				if (pos % 64 == 0) { // A block boundary, also covers the end of the last full block
+					result.offsets[r] = ranks[pos / 64];
+					continue;
+				}
+				const auto below = (std::uint64_t{1} << (pos % 64)) - 1;
+				result.offsets[r] = ranks[pos / 64] + static_cast<std::size_t>(std::popcount(masks[pos / 64] & below));
+			}
+		});
+
+		result.data.resize(ranks.back());
+		parallel_for(blocks, threads, [&](std::size_t b0, std::size_t b1) {
+			auto* out = result.data.data() + ranks[b0];
+			for (auto b = b0; b < b1; ++b) {
+				for (auto mask = masks[b]; mask != 0; mask &= mask - 1) {
+					*out++ = first[b * 64 + static_cast<std::size_t>(std::countr_zero(mask))];
+				}
+			}
+		});
+		return result;
+	}
+
+	auto filter_column(const string_column& column, const filter& predicate, const batch_options& options)
+	    -> filtered_column {
+		return filter_column(column, predicate_handle(predicate), options);
+	}
+
+	// Shared cache of materialised views
+	namespace {
+		struct cache_key {
+			const char* data;
+			std::size_t length;
+			const detail::predicate_state* predicate;
+
+			friend auto operator==(const cache_key&, const cache_key&) -> bool = default;
+		};
+
+		// Mixes all three fields into every bit, the shard is picked from the high half and the bucket from the low
+		struct cache_key_hash {
+			auto operator()(const cache_key& key) const noexcept -> std::size_t {
+				auto h = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(key.data));
+				h ^= (static_cast<std::uint64_t>(key.length) << 32)
+				     ^ std::rotl(static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(key.predicate)), 17);
+				h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+				h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+				return static_cast<std::size_t>(h ^ (h >> 31));
+			}
+		};
+
+		constexpr auto max_cache_shards = std::size_t{16};
+		constexpr auto min_shard_capacity = std::size_t{64}; // Smaller shards would evict too eagerly
+	} // namespace
+
+	struct string_cache::shard {
+		// A slot pins the predicate and any owned buffer of its key, so neither address can be reused by another
+		// predicate or buffer while the entry exists
+		struct slot {
+			cache_key key;
+			std::shared_ptr<const std::string> value;
+			predicate_handle predicate;
+			shared_buffer owner;
+			bool referenced; // Set by every hit, cleared as the clock hand passes
+		};
+
+		// Return the cached value for key, if any, marking it as recently used
+		auto find(const cache_key& key) -> std::shared_ptr<const std::string> {
+			const auto it = index.find(key);
+			if (it == index.end()) {
+				return nullptr;
+			}
+			slots[it->second].referenced = true;
+			return slots[it->second].value;
+		}
+
+		auto insert(const cache_key& key, std::shared_ptr<const std::string> value, const filtered_string_view& fsv)
+		    -> void {
+			auto entry = slot{key, std::move(value), fsv.shared_predicate(), fsv.owner(), false};
+			if (slots.size() < capacity) {
+				index.emplace(key, slots.size());
+				slots.push_back(std::move(entry));
+				return;
+			}
+			// Give every recently used slot a second chance, then replace the first one that has had it
+			while (slots[hand].referenced) {
+				slots[hand].referenced = false;
+				hand = (hand + 1) % slots.size();
+			}
+			index.erase(slots[hand].key);
+			index.emplace(key, hand);
+			slots[hand] = std::move(entry);
+			hand = (hand + 1) % slots.size();
+			++evictions;
+		}
+
+		auto erase(std::size_t i) -> void {
+			index.erase(slots[i].key);
+			if (i != slots.size() - 1) {
+				slots[i] = std::move(slots.back());
+				index[slots[i].key] = i;
+			}
+			slots.pop_back();
+			hand = slots.empty() ? 0 : hand % slots.size();
+		}
+
+		std::mutex mutex;
+		std::size_t capacity = 0;
+		std::vector<slot> slots;
+		std::unordered_map<cache_key, std::size_t, cache_key_hash> index; // Slot of every cached key
+		std::size_t hand = 0; // The next slot the clock looks at
+		std::uint64_t hits = 0;
+		std::uint64_t misses = 0;
+		std::uint64_t evictions = 0;
+	};
+
+	auto cache_stats::hit_rate() const noexcept -> double {
+		const auto lookups = hits + misses;
+		return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+	}
+
+	string_cache::string_cache(std::size_t capacity, std::size_t max_size)
+	: max_size_(max_size)
+	, shard_count_(std::clamp(capacity / min_shard_capacity, std::size_t{1}, max_cache_shards))
+	, shards_(std::make_unique<shard[]>(shard_count_)) {
+		// Share the capacity out as evenly as possible, a zero capacity caches nothing
+		for (std::size_t i = 0; i < shard_count_; ++i) {
+			shards_[i].capacity = capacity / shard_count_ + (i < capacity % shard_count_ ? 1 : 0);
+			shards_[i].slots.reserve(shards_[i].capacity);
+		}
+	}
+
+	string_cache::~string_cache() = default;
+
+	auto string_cache::global() -> string_cache& {
+		static auto* const cache = new string_cache();
+		return *cache;
+	}
+
+	auto string_cache::get(const filtered_string_view& fsv) -> std::shared_ptr<const std::string> {
+		const auto key = cache_key{fsv.data(), fsv.original_size(), &fsv.shared_predicate().state()};
+		auto& s = shards_[(cache_key_hash()(key) >> 32) % shard_count_];
+		{
+			const auto lock = std::lock_guard<std::mutex>(s.mutex);
+			if (auto value = s.find(key)) {
+				++s.hits;
+				return value;
+			}
+			++s.misses;
+		}
+
+		// Materialise without holding the lock, so a slow predicate does not stall the rest of the shard
+		auto value = std::make_shared<const std::string>(static_cast<std::string>(fsv));
+		if (value->size() > max_size_ or s.capacity == 0) {
+			return value;
+		}
+		const auto lock = std::lock_guard<std::mutex>(s.mutex);
+		if (auto cached = s.find(key)) { // Another thread missed at the same time and got here first
+			return cached;
+		}
+		s.insert(key, value, fsv);
+		return value;
+	}
+
+	auto string_cache::invalidate(const char* data, std::size_t length) -> std::size_t {
+		auto dropped = std::size_t{0};
+		for (std::size_t i = 0; i < shard_count_; ++i) {
+			auto& s = shards_[i];
+			const auto lock = std::lock_guard<std::mutex>(s.mutex);
+			for (std::size_t slot = 0; slot < s.slots.size();) {
+				const auto& key = s.slots[slot].key;
+				// Empty views are dropped when they sit inside the range, others when they share a character with it:
+				// either the view starts inside the range, or the range starts inside the view
+				const auto overlaps = key.length == 0
+				                          ? offset_from(data, key.data) <= length
+				                          : offset_from(data, key.data) < length
+				                                or (key.data != data and offset_from(key.data, data) < key.length);
+				if (overlaps) {
+					s.erase(slot);
+					++dropped;
+				}
+				else {
+					++slot;
+				}
+			}
+		}
+		return dropped;
+	}
+
+	auto string_cache::clear() -> void {
+		for (std::size_t i = 0; i < shard_count_; ++i) {
+			const auto lock = std::lock_guard<std::mutex>(shards_[i].mutex);
+			shards_[i].slots.clear();
+			shards_[i].index.clear();
+			shards_[i].hand = 0;
+		}
+	}
+
+	auto string_cache::stats() const -> cache_stats {
+		auto result = cache_stats();
+		for (std::size_t i = 0; i < shard_count_; ++i) {
+			const auto lock = std::lock_guard<std::mutex>(shards_[i].mutex);
+			result.hits += shards_[i].hits;
+			result.misses += shards_[i].misses;
+			result.evictions += shards_[i].evictions;
+			result.entries += shards_[i].slots.size();
+		}
+		return result;
+	}
+
+	auto string_cache::capacity() const noexcept -> std::size_t {
+		auto total = std::size_t{0};
+		for (std::size_t i = 0; i < shard_count_; ++i) {
+			total += shards_[i].capacity;
+		}
+		return total;
+	}
+
+	auto cached_string(const filtered_string_view& fsv) -> std::shared_ptr<const std::string> {
+		return string_cache::global().get(fsv);
 	}
 
 	// 2.9 Iterator
 	// Constructors of iterator
 	filtered_string_view::const_iterator::const_iterator()
 	: ptr_(nullptr)
-	, predicate_(nullptr) {}
-
-	filtered_string_view::const_iterator::const_iterator(const char* ptr, const filter& predicate)
+	, first_(nullptr)
+	, last_(nullptr)
+	, predicate_()
+	, owner_()
+	, block_(no_block)
+	, mask_(0) {}
+
+	filtered_string_view::const_iterator::const_iterator(const char* first,
+	                                                     const char* ptr,
+	                                                     const char* last,
+	                                                     predicate_handle predicate,
+	                                                     shared_buffer owner)
 	: ptr_(ptr)
-	, predicate_(&predicate) {
-		while (ptr_ and *ptr_ and !(*predicate_)(*ptr_)) {
+	, first_(first)
+	, last_(last)
+	, predicate_(std::move(predicate))
+	, owner_(std::move(owner))
+	, block_(no_block)
+	, mask_(0) {
+		const auto& state = predicate_.state();
+		if (state.kind == detail::predicate_kind::identity) {
+			return;
+		}
+		if (steps_by_block(state)) {
+			seek_forward(static_cast<std::size_t>(ptr_ - first_));
+			return;
+		}
+		while (ptr_ != last_ and !keeps(state, *ptr_)) { // Move to the first character that is kept
 			++ptr_;
 		}
 	}
 
+	// Blocks are aligned to first_, so a cached block serves steps in either direction
+	auto filtered_string_view::const_iterator::load_block(std::size_t offset) -> void {
+		block_ = offset / 64;
+		const auto start = block_ * 64;
+		mask_ = block_mask(predicate_.state(),
+		                   first_ + start,
+		                   std::min(std::size_t{64}, static_cast<std::size_t>(last_ - first_) - start));
+	}
+
+	auto filtered_string_view::const_iterator::seek_forward(std::size_t offset) -> void {
+		const auto size = static_cast<std::size_t>(last_ - first_);
+		while (offset < size) {
+			if (offset / 64 != block_) {
+				load_block(offset);
+			}
+			// Drop the bits for characters before offset and jump straight to the next set bit
+			if (const auto bits = mask_ & (~std::uint64_t{0} << (offset % 64)); bits != 0) {
+				ptr_ = first_ + block_ * 64 + static_cast<std::size_t>(std::countr_zero(bits));
+				return;
+			}
+			offset = (block_ + 1) * 64;
+		}
+		ptr_ = last_;
+	}
+
+	auto filtered_string_view::const_iterator::seek_backward(std::size_t offset) -> bool {
+		while (true) {
+			if (offset / 64 != block_) {
+				load_block(offset);
+			}
+			// Keep the bits for characters up to offset and jump straight to the highest one
+			const auto shift = 63 - offset % 64;
+			if (const auto bits = mask_ << shift; bits != 0) {
+				ptr_ = first_ + offset - static_cast<std::size_t>(std::countl_zero(bits));
+				return true;
+			}
+			if (block_ == 0) { // Only reachable when decrementing the first kept character
+				ptr_ = first_;
+				return false;
+			}
+			offset = block_ * 64 - 1;
+		}
+	}
+
+	auto filtered_string_view::const_iterator::retreat() -> bool {
+		if (ptr_ == first_) {
+			return false;
+		}
+		const auto& state = predicate_.state();
+		if (state.kind == detail::predicate_kind::identity) {
+			--ptr_;
+			return true;
+		}
+		if (steps_by_block(state)) {
+			const auto* from = ptr_;
+			if (seek_backward(static_cast<std::size_t>(ptr_ - first_) - 1)) {
+				return true;
+			}
+			ptr_ = from;
+			return false;
+		}
+		for (const char* c = ptr_; c != first_;) {
+			if (keeps(state, *--c)) {
+				ptr_ = c;
+				return true;
+			}
+		}
+		return false;
+	}
+
 	// Member Operators of iterator
 	auto filtered_string_view::const_iterator::operator*() const -> reference {
 		return *ptr_;
 	}
 
+	auto filtered_string_view::const_iterator::operator->() const -> pointer {
+		return ptr_;
+	}
+
 	auto filtered_string_view::const_iterator::operator++() -> const_iterator& {
+		const auto& state = predicate_.state();
+		if (state.kind == detail::predicate_kind::identity) { // Every character is kept
+			++ptr_;
+			return *this;
+		}
+		if (steps_by_block(state)) {
+			seek_forward(static_cast<std::size_t>(ptr_ - first_) + 1);
+			return *this;
+		}
 		do {
 			++ptr_;
-		} while (ptr_ and *ptr_ and !(*predicate_)(*ptr_)); // Skip all characters that do not match the predicate
+		} while (ptr_ != last_ and !keeps(state, *ptr_)); // Skip all characters that do not match the predicate
 		return *this;
 	}
 
@@ -338,9 +2250,19 @@ namespace fsv {
 	}
 
 	auto filtered_string_view::const_iterator::operator--() -> const_iterator& {
+		const auto& state = predicate_.state();
+		if (state.kind == detail::predicate_kind::identity) { // Every character is kept
+			--ptr_;
+			return *this;
+		}
+		if (steps_by_block(state)) {
+			seek_backward(static_cast<std::size_t>(ptr_ - first_) - 1);
+			return *this;
+		}
+		// Decrementing requires a kept character before ptr_, so the loop stops before leaving the range
 		do {
 			--ptr_;
-		} while (ptr_ and *ptr_ and !(*predicate_)(*ptr_)); // Skip all characters that do not match the predicate
+		} while (!keeps(state, *ptr_)); // Skip all characters that do not match the predicate
 		return *this;
 	}
 
@@ -358,13 +2280,60 @@ namespace fsv {
 		return ptr_ != other.ptr_;
 	}
 
+	auto filtered_string_view::const_iterator::operator==(std::default_sentinel_t) const -> bool {
+		return ptr_ == last_;
+	}
+
+	filtered_string_view::const_reverse_iterator::const_reverse_iterator(const_iterator base)
+	: current_(std::move(base))
+	, past_end_(not current_.retreat()) {}
+
+	auto filtered_string_view::const_reverse_iterator::base() const -> const_iterator {
+		return past_end_ ? current_ : std::next(current_);
+	}
+
+	auto filtered_string_view::const_reverse_iterator::operator*() const -> reference {
+		return *current_;
+	}
+
+	auto filtered_string_view::const_reverse_iterator::operator->() const -> pointer {
+		return current_.operator->();
+	}
+
+	auto filtered_string_view::const_reverse_iterator::operator++() -> const_reverse_iterator& {
+		past_end_ = not current_.retreat();
+		return *this;
+	}
+
+	auto filtered_string_view::const_reverse_iterator::operator++(int) -> const_reverse_iterator {
+		auto tmp = *this;
+		++(*this);
+		return tmp;
+	}
+
+	auto filtered_string_view::const_reverse_iterator::operator--() -> const_reverse_iterator& {
+		if (past_end_) { // current_ already rests on the first kept character
+			past_end_ = false;
+		}
+		else {
+			++current_;
+		}
+		return *this;
+	}
+
+	auto filtered_string_view::const_reverse_iterator::operator--(int) -> const_reverse_iterator {
+		auto tmp = *this;
+		--(*this);
+		return tmp;
+	}
+
+	auto filtered_string_view::const_reverse_iterator::operator==(const const_reverse_iterator& other) const -> bool {
+		return past_end_ == other.past_end_ and current_ == other.current_;
+	}
+
 	// 2.10 begin(), end(), cbegin(), cend(), rbegin(), rend(), crbegin(), crend()
 	auto filtered_string_view::begin() const -> const_iterator {
-		const char* ptr = pointer_;
-		while (ptr != pointer_ + length_ && !predicate_(*ptr)) {
-			++ptr;
-		}
-		return const_iterator(ptr, predicate_);
+		return const_iterator(pointer_, pointer_, pointer_ + length_, predicate_, owner_);
 	}
 
 	auto filtered_string_view::cbegin() const -> const_iterator {
@@ -372,7 +2341,7 @@ namespace fsv {
 	}
 
 	auto filtered_string_view::end() const -> const_iterator {
-		return const_iterator(pointer_ + length_, predicate_);
+		return const_iterator(pointer_, pointer_ + length_, pointer_ + length_, predicate_, owner_);
 	}
 
 	auto filtered_string_view::cend() const -> const_iterator {
@@ -2,19 +2,404 @@
 #define COMP6771_ASS2_FSV_H
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <compare>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
+#include <ranges>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 namespace fsv {
 	using filter = std::function<bool(const char&)>; // Define the alias
 
+	// A set of byte values stored as a 256-bit table, usable directly as a filter
+	// Views and compose recognise byte classes inside a filter and test them with a single table lookup
+	class byte_class {
+	 public:
+		constexpr byte_class() noexcept = default; // The empty class
+
+		// The class holding every character of chars
+		static constexpr auto of(std::string_view chars) noexcept -> byte_class {
+			auto result = byte_class();
+			for (const char c : chars) {
+				result.insert(c);
+			}
+			return result;
+		}
+
+		// The class holding the byte values first to last inclusive, compared as unsigned char
+		static constexpr auto range(char first, char last) noexcept -> byte_class {
+			auto result = byte_class();
+			for (auto b = static_cast<unsigned>(static_cast<unsigned char>(first));
+			     b <= static_cast<unsigned char>(last);
+			     ++b)
+			{
+				result.insert(static_cast<char>(b));
+			}
+			return result;
+		}
+
+		// The class holding every byte value
+		static constexpr auto all() noexcept -> byte_class {
+			return ~byte_class();
+		}
+
+		constexpr auto insert(char c) noexcept -> byte_class& {
+			const auto b = static_cast<unsigned char>(c);
+			bits_[b >> 6U] |= std::uint64_t{1} << (b & 63U);
+			return *this;
+		}
+
+		constexpr auto contains(char c) const noexcept -> bool {
+			const auto b = static_cast<unsigned char>(c);
+			return ((bits_[b >> 6U] >> (b & 63U)) & 1U) != 0;
+		}
+
+		constexpr auto operator()(const char& c) const noexcept -> bool {
+			return contains(c);
+		}
+
+		// Number of byte values in the class
+		constexpr auto count() const noexcept -> std::size_t {
+			auto total = std::size_t{0};
+			for (const auto word : bits_) {
+				total += static_cast<std::size_t>(std::popcount(word));
+			}
+			return total;
+		}
+
+		// The table as four 64-bit words, bit b of the table is bit (b % 64) of word b / 64
+		constexpr auto words() const noexcept -> const std::array<std::uint64_t, 4>& {
+			return bits_;
+		}
+
+		friend constexpr auto operator&(const byte_class& lhs, const byte_class& rhs) noexcept -> byte_class {
+			auto result = lhs;
+			for (std::size_t i = 0; i < result.bits_.size(); ++i) {
+				result.bits_[i] &= rhs.bits_[i];
+			}
+			return result;
+		}
+
+		friend constexpr auto operator|(const byte_class& lhs, const byte_class& rhs) noexcept -> byte_class {
+			auto result = lhs;
+			for (std::size_t i = 0; i < result.bits_.size(); ++i) {
+				result.bits_[i] |= rhs.bits_[i];
+			}
+			return result;
+		}
+
+		friend constexpr auto operator~(const byte_class& cls) noexcept -> byte_class {
+			auto result = cls;
+			for (auto& word : result.bits_) {
+				word = ~word;
+			}
+			return result;
+		}
+
+		friend constexpr auto operator==(const byte_class& lhs, const byte_class& rhs) noexcept -> bool = default;
+
+	 private:
+		std::array<std::uint64_t, 4> bits_ = {};
+	};
+
+	// Common ASCII byte classes, matching the <cctype> functions in the "C" locale
+	namespace classes {
+		inline constexpr auto upper = byte_class::range('A', 'Z');
+		inline constexpr auto lower = byte_class::range('a', 'z');
+		inline constexpr auto alpha = upper | lower;
+		inline constexpr auto digit = byte_class::range('0', '9');
+		inline constexpr auto alnum = alpha | digit;
+		inline constexpr auto xdigit = digit | byte_class::range('a', 'f') | byte_class::range('A', 'F');
+		inline constexpr auto space = byte_class::of(" \t\n\v\f\r");
+		inline constexpr auto punct = byte_class::range('!', '~') & ~alnum;
+	} // namespace classes
+
+	// Evaluate predicate once for each of the 256 byte values and return the class of values it keeps
+	// Only meaningful for pure predicates, whose result depends on nothing but the character's value
+	auto tabulate(const filter& predicate) -> byte_class;
+
+	// Constructor tag asking a view to tabulate its predicate, so it is never called again after construction
+	struct tabulate_t {
+		explicit tabulate_t() = default;
+	};
+	inline constexpr auto tabulated = tabulate_t();
+
+	// Element types whose objects can be read as characters in place
+	template<typename T>
+	concept byte_like = std::same_as<std::remove_cv_t<T>, char> or std::same_as<std::remove_cv_t<T>, signed char>
+	                    or std::same_as<std::remove_cv_t<T>, unsigned char>
+	                    or std::same_as<std::remove_cv_t<T>, char8_t> or std::same_as<std::remove_cv_t<T>, std::byte>;
+
+	// Contiguous ranges of byte-like elements, such as std::span<const std::byte> or std::vector<std::uint8_t>
+	// Strings and arrays are excluded, they are handled by the string and NUL-terminated constructors
+	template<typename R>
+	concept byte_range = std::ranges::contiguous_range<R> and std::ranges::sized_range<R>
+	                     and byte_like<std::ranges::range_value_t<R>> and not std::is_array_v<std::remove_cvref_t<R>>
+	                     and not std::is_convertible_v<const R&, std::string_view>;
+
+	namespace detail {
+		// What the library knows about a predicate, used to pick a faster scanning strategy
+		enum class predicate_kind {
+			identity, // Keeps every character, so the view behaves exactly like a std::string_view
+			table, // A byte_class, evaluated with one table lookup per character
+			generic, // An arbitrary filter that has to be called once per character
+			mask, // A packed bitmask over a fixed range of characters, read 64 bits at a time
+		};
+
+		// The filter built by compose, kept flat so that composing a composition adds no call layers
+		struct composed_filter {
+			byte_class classes; // Intersection of every byte-class filter, checked first
+			std::shared_ptr<const std::vector<filter>> filters; // The remaining filters in evaluation order
+			std::shared_ptr<const std::vector<std::size_t>> order; // order[i] is the position filters[i] was given in
+
+			auto operator()(const char& c) const -> bool;
+		};
+
+		// A selection materialised as one bit per character of [base, base + length)
+		// Characters are identified by their address, so every view into that range can share the same bitmask
+		struct bitmask {
+			const char* base = nullptr;
+			std::size_t length = 0;
+			std::vector<std::uint64_t> words; // Bit i of word w is set when base[64 * w + i] is kept, later bits are 0
+
+			auto offset_of(const char* p) const noexcept -> std::size_t; // p - base, or more than length if p < base
+			auto contains(const char& c) const noexcept -> bool; // Whether c lies in the range and is kept
+			auto operator()(const char& c) const noexcept -> bool; // Same as contains, so a bitmask works as a filter
+			// The bits of base[offset, offset + n), requires n <= 64 and offset + n <= length
+			auto bits(std::size_t offset, std::size_t n) const noexcept -> std::uint64_t;
+		};
+
+		// The filter of a bitmask view, sharing the bitmask with the predicate state
+		struct mask_filter {
+			std::shared_ptr<const bitmask> mask;
+
+			auto operator()(const char& c) const -> bool;
+		};
+
+		// A byte_class regrouped for the SIMD kernels
+		// Bit k of low[n] is set when the class contains byte 16 * k + n, and bit k of high[n] when it contains
+		// byte 128 + 16 * k + n. A class that is a union of at most three ranges of byte values also lists them
+		struct simd_table {
+			std::array<std::uint8_t, 16> low;
+			std::array<std::uint8_t, 16> high;
+			std::array<std::array<std::uint8_t, 2>, 3> ranges; // First and last byte of each range
+			std::uint8_t range_count; // Number of ranges used
+			bool ranged; // Whether ranges describes the whole class
+		};
+
+		// The shared, immutable state behind a predicate_handle
+		struct predicate_state {
+			filter fn; // The wrapped predicate, never modified after construction
+			predicate_kind kind; // How the predicate may be evaluated
+			byte_class table; // The kept bytes when kind is table
+			simd_table simd; // table regrouped for the SIMD kernels when kind is table
+			std::shared_ptr<const bitmask> mask; // The selection when kind is mask
+			mutable std::atomic<long> refs; // Number of handles referring to this state, unused for the default state
+			mutable std::atomic<std::uint32_t> id = 0; // Registry id, assigned the first time the state is interned
+		};
+
+		// The materialised characters shared by the copies of a memoizing view, filled on first use
+		struct memo {
+			std::size_t max_size; // The longest result that is kept
+			std::once_flag once;
+			std::atomic<bool> ready = false; // Set once the fields below are filled
+			std::size_t size = 0; // Number of kept characters
+			bool kept = false; // Whether text holds them, which it does when size <= max_size
+			std::string text;
+			std::atomic<long> refs = 1; // Number of views sharing this memo
+		};
+
+		// The shared, immutable characters behind a shared_buffer
+		struct buffer_state {
+			std::string text; // Never modified after construction
+			mutable std::atomic<long> refs; // Number of shared_buffers referring to this state
+		};
+
+		// A pointer sharing ownership of a state through the state's atomic refs member, the counting behind
+		// predicate_handle, shared_buffer and memoizing views. Copies are pointer-sized and only bump the counter,
+		// and the last pointer to let go deletes the state
+		template<typename T>
+		class intrusive_ptr {
+		 public:
+			intrusive_ptr() noexcept = default; // Holds no state
+			explicit intrusive_ptr(T* state) noexcept // Adopts state, whose count must already include this pointer
+			: state_(state) {}
+			intrusive_ptr(const intrusive_ptr& other) noexcept
+			: state_(other.state_) {
+				retain();
+			}
+			intrusive_ptr(intrusive_ptr&& other) noexcept // Leaves other holding no state
+			: state_(std::exchange(other.state_, nullptr)) {}
+			~intrusive_ptr() {
+				release();
+			}
+
+			auto operator=(const intrusive_ptr& other) noexcept -> intrusive_ptr& {
+				if (state_ != other.state_) {
+					other.retain(); // Retain first so that releasing our state cannot free other's
+					release();
+					state_ = other.state_;
+				}
+				return *this;
+			}
+
+			auto operator=(intrusive_ptr&& other) noexcept -> intrusive_ptr& {
+				if (this != &other) {
+					release();
+					state_ = std::exchange(other.state_, nullptr);
+				}
+				return *this;
+			}
+
+			auto get() const noexcept -> T* {
+				return state_;
+			}
+
+			auto operator->() const noexcept -> T* {
+				return state_;
+			}
+
+			// Number of pointers sharing the state, 0 when none is held
+			auto use_count() const noexcept -> long {
+				return state_ != nullptr ? state_->refs.load(std::memory_order_relaxed) : 0;
+			}
+
+			explicit operator bool() const noexcept {
+				return state_ != nullptr;
+			}
+
+			// Two pointers are equal when they share the same state
+			friend auto operator==(const intrusive_ptr& lhs, const intrusive_ptr& rhs) noexcept -> bool {
+				return lhs.state_ == rhs.state_;
+			}
+
+		 private:
+			auto retain() const noexcept -> void {
+				if (state_ != nullptr) {
+					state_->refs.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+
+			auto release() noexcept -> void {
+				// The last pointer to let go frees the state, acq_rel orders all prior uses before the delete
+				if (state_ != nullptr and state_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					delete state_;
+				}
+			}
+
+			T* state_ = nullptr;
+		};
+	} // namespace detail
+
+	// A reference-counted handle to an immutable predicate
+	// Copying a handle only bumps an atomic counter, so copies are pointer-sized and never allocate
+	class predicate_handle {
+	 public:
+		predicate_handle() noexcept; // Refers to the shared default predicate
+		explicit predicate_handle(filter predicate); // Wraps predicate in a new shared state, unless it is the
+		                                             // default predicate
+		predicate_handle(const predicate_handle& other) noexcept = default;
+		predicate_handle(predicate_handle&& other) noexcept = default; // Leaves other with the default predicate
+		~predicate_handle() = default;
+
+		auto operator=(const predicate_handle& other) noexcept -> predicate_handle& = default;
+		auto operator=(predicate_handle&& other) noexcept -> predicate_handle& = default;
+
+		auto operator()(const char& c) const -> bool; // Evaluate the predicate
+		auto get() const noexcept -> const filter&; // Return the wrapped predicate
+		auto use_count() const noexcept -> long; // Number of handles sharing the state, 0 for the default predicate
+		auto is_default() const noexcept -> bool; // Whether the predicate keeps every character
+		auto state() const noexcept -> const detail::predicate_state&; // The shared state, for the library's scanners
+
+		// Intern the predicate in the process-wide registry and return its id, 0 is the default predicate
+		// Interned predicates stay alive until the program exits
+		auto id() const -> std::uint32_t;
+		// Look up an interned predicate, throws std::out_of_range for ids that were never handed out
+		static auto from_id(std::uint32_t id) -> const predicate_handle&;
+
+		// Two handles are equal when they share the same state
+		friend auto operator==(const predicate_handle& lhs, const predicate_handle& rhs) noexcept -> bool {
+			return lhs.state_ == rhs.state_;
+		}
+
+	 private:
+		detail::intrusive_ptr<const detail::predicate_state> state_; // Null for the default predicate
+	};
+
+	// An immutable, reference-counted buffer of characters for views that own their data
+	// A view made over a shared_buffer keeps it alive, and so does everything derived from that view: copies, pieces of
+	// split, substr, compose, bitmask views and iterators. Such views can be handed between threads and pipeline stages
+	// without copying the characters or tracking the lifetime of the source. Copying only bumps an atomic counter
+	class shared_buffer {
+	 public:
+		shared_buffer() noexcept; // Holds no buffer
+		explicit shared_buffer(std::string text); // Takes text over, without copying when it is moved in
+		explicit shared_buffer(std::string_view text); // Copies text
+		explicit shared_buffer(const char* text); // Copies text up to its terminating NUL
+		shared_buffer(const shared_buffer& other) noexcept = default;
+		shared_buffer(shared_buffer&& other) noexcept = default; // Leaves other holding no buffer
+		~shared_buffer() = default;
+
+		auto operator=(const shared_buffer& other) noexcept -> shared_buffer& = default;
+		auto operator=(shared_buffer&& other) noexcept -> shared_buffer& = default;
+
+		auto data() const noexcept -> const char*; // Null when no buffer is held
+		auto size() const noexcept -> std::size_t;
+		auto use_count() const noexcept -> long; // Number of shared_buffers sharing the buffer, 0 when none is held
+		// Whether [first, first + length) lies inside the buffer; always false when no buffer is held
+		auto contains(const char* first, std::size_t length) const noexcept -> bool;
+		explicit operator bool() const noexcept; // Whether a buffer is held
+
+		// Two shared_buffers are equal when they share the same buffer
+		friend auto operator==(const shared_buffer& lhs, const shared_buffer& rhs) noexcept -> bool {
+			return lhs.state_ == rhs.state_;
+		}
+
+	 private:
+		detail::intrusive_ptr<const detail::buffer_state> state_;
+	};
+
+	// Instruction sets the byte-class kernels can use, in increasing order of width
+	enum class simd_level {
+		scalar,
+		sse2, // Byte classes made of at most three ranges are tested with compares, others fall back to scalar
+		sse42, // Any byte class, 16 bytes at a time with a nibble lookup
+		avx2, // Any byte class, 32 bytes at a time
+		avx512, // Any byte class, 64 bytes at a time (AVX-512BW)
+	};
+
+	// The kernels are chosen once, for the best level the CPU supports, the first time a view needs them. Setting the
+	// environment variable FSV_FORCE_SCALAR to anything but 0 forces the scalar kernels
+	auto supported_simd_level() -> simd_level; // The best level the running CPU supports
+	auto active_simd_level() -> simd_level; // The level of the kernels in use
+	// Switch to the kernels for level, or the best supported level below it, and return the level now in use
+	// Meant for tests and benchmarks; views already being scanned on other threads may use either set of kernels
+	auto use_simd_level(simd_level level) -> simd_level;
+	auto simd_level_name(simd_level level) -> const char*;
+
+	// A run of kept characters, offset and length counted in characters from the start of a view's data
+	struct keep_range {
+		std::size_t offset;
+		std::size_t length;
+	};
+
 	class filtered_string_view {
 	 public:
 		static auto default_predicate(const char&) -> bool; // The default predicate function, which always returns true
@@ -26,6 +411,54 @@ namespace fsv {
 		filtered_string_view(const char* str); // 2.4.4 Implicit Null-Terminated String Constructor
 		filtered_string_view(const char* str, filter predicate); // 2.4.5 Null-Terminated String with Predicate
 		                                                         // Constructor
+		filtered_string_view(const std::string& str, filter predicate, tabulate_t); // Tabulate a pure predicate
+		filtered_string_view(const char* str, filter predicate, tabulate_t); // Tabulate a pure predicate
+		filtered_string_view(const std::string& str, predicate_handle predicate); // Share an existing predicate
+		filtered_string_view(const char* str, predicate_handle predicate); // Share an existing predicate
+
+		// Length-bounded constructors, they never look for a terminating NUL and work on any span of characters
+		filtered_string_view(std::string_view str); // Implicit string_view Constructor
+		filtered_string_view(std::string_view str, filter predicate);
+		filtered_string_view(std::string_view str, predicate_handle predicate);
+		filtered_string_view(const char* data, std::size_t length); // View exactly length characters from data
+		filtered_string_view(const char* data, std::size_t length, filter predicate);
+		filtered_string_view(const char* data, std::size_t length, predicate_handle predicate);
+
+		// Owning Constructors, keeping buffer alive for as long as the view or anything derived from it exists
+		filtered_string_view(shared_buffer buffer); // View all of buffer
+		filtered_string_view(shared_buffer buffer, filter predicate);
+		filtered_string_view(shared_buffer buffer, predicate_handle predicate);
+		// View length characters from data, keeping owner alive; throws std::out_of_range if owner holds a buffer that
+		// does not contain them. With an empty owner this is the non-owning constructor
+		filtered_string_view(const char* data, std::size_t length, predicate_handle predicate, shared_buffer owner);
+
+		// Bitmask Constructors, keeping the characters selected by a bitmask or a list of keep ranges
+		// The selection is stored as a bitmask view (see masked), so no per-character predicate is ever called.
+		// Bit i of word w of mask selects data[64 * w + i]; throws std::invalid_argument if mask has fewer than
+		// (length + 63) / 64 words. Ranges may come in any order and overlap; throws std::out_of_range if a range
+		// reaches past length
+		filtered_string_view(const char* data, std::size_t length, std::span<const std::uint64_t> mask);
+		filtered_string_view(const char* data, std::size_t length, std::span<const keep_range> ranges);
+		filtered_string_view(std::string_view str, std::span<const std::uint64_t> mask);
+		filtered_string_view(std::string_view str, std::span<const keep_range> ranges);
+
+		// Binary Data Constructors, viewing a contiguous range of bytes in place without copying
+		template<byte_range R>
+		explicit filtered_string_view(const R& bytes)
+		: filtered_string_view(reinterpret_cast<const char*>(std::ranges::data(bytes)), std::ranges::size(bytes)) {}
+
+		template<byte_range R>
+		filtered_string_view(const R& bytes, filter predicate)
+		: filtered_string_view(reinterpret_cast<const char*>(std::ranges::data(bytes)),
+		                       std::ranges::size(bytes),
+		                       std::move(predicate)) {}
+
+		template<byte_range R>
+		filtered_string_view(const R& bytes, predicate_handle predicate)
+		: filtered_string_view(reinterpret_cast<const char*>(std::ranges::data(bytes)),
+		                       std::ranges::size(bytes),
+		                       std::move(predicate)) {}
+
 		filtered_string_view(const filtered_string_view& other); // 2.4.6 Copy Constructor
 		filtered_string_view(filtered_string_view&& other) noexcept; // 2.4.6 Move Constructor
 		~filtered_string_view() = default; // 2.5 Destructor
@@ -44,39 +477,112 @@ namespace fsv {
 		auto empty() const -> bool; // 2.6.3 Return whether the fsv is empty
 		auto data() const -> const char*; // 2.6.4 Return the pointer to the underlying data
 		auto predicate() const -> const filter&; // 2.6.5 Return the predicate used for filtering
+		auto shared_predicate() const -> const predicate_handle&; // Return the handle owning the predicate
+		auto owner() const noexcept -> const shared_buffer&; // The buffer the view keeps alive, if any
+
+		// Memoized materialisation
+		// memoized returns a copy of the view that materialises its kept characters the first time they are needed and
+		// shares the result with all of its copies. Conversion to std::string, size() and append_to then copy the
+		// cached characters instead of running the predicate again; the first conversion is thread-safe. Results
+		// longer than max_size are not kept, so the cache never holds more than max_size characters, but their size
+		// still is. Views derived from a memoizing view, such as substr, start without a cache
+		static constexpr std::size_t default_memo_size = 64 * 1024;
+		auto memoized(std::size_t max_size = default_memo_size) const -> filtered_string_view;
+		auto is_memoized() const noexcept -> bool;
+		// Copy up to cap kept characters to dst without allocating and return how many were copied; no NUL is added
+		auto copy_to(char* dst, std::size_t cap) const -> std::size_t;
+		// Append the kept characters to out, growing it at most once for byte-class predicates
+		auto append_to(std::string& out) const -> void;
 
 		// 2.9 Iterator
+		// Iterators share ownership of the predicate and of an owned buffer, so they stay valid after the view they
+		// came from is destroyed
+		// For byte-class predicates they move a 64-byte block at a time, caching the block's keep mask and stepping
+		// between its set bits instead of testing every character
+		class const_reverse_iterator;
 		class const_iterator {
 		 public:
 			// Type definition
+			using iterator_concept = std::bidirectional_iterator_tag;
 			using iterator_category = std::bidirectional_iterator_tag;
 			using value_type = char;
 			using difference_type = ptrdiff_t;
-			using pointer = void;
+			using pointer = const char*;
 			using reference = const char&;
 
 			// Constructors of iterator
 			const_iterator();
-			const_iterator(const char* ptr, const filter& predicate);
+			const_iterator(const char* first,
+			               const char* ptr,
+			               const char* last,
+			               predicate_handle predicate,
+			               shared_buffer owner = shared_buffer()); // Iterate [first, last), starting at ptr
 
 			// Member Operators of iterator
 			auto operator*() const -> reference;
+			auto operator->() const -> pointer;
 			auto operator++() -> const_iterator&;
 			auto operator++(int) -> const_iterator;
 			auto operator--() -> const_iterator&;
 			auto operator--(int) -> const_iterator;
 			auto operator==(const const_iterator& other) const -> bool;
 			auto operator!=(const const_iterator& other) const -> bool;
+			auto operator==(std::default_sentinel_t) const -> bool; // Whether the iterator reached the end of its range
 
 		 private:
+			static constexpr auto no_block = static_cast<std::size_t>(-1);
+
+			auto load_block(std::size_t offset) -> void; // Cache the keep mask of the block holding first_[offset]
+			auto seek_forward(std::size_t offset) -> void; // Move to the first kept character at or after offset
+			auto seek_backward(std::size_t offset) -> bool; // Move to the last kept character at or before offset
+			auto retreat() -> bool; // Move to the previous kept character, or return false if there is none
+
+			friend class const_reverse_iterator;
+
 			const char* ptr_;
-			const filter* predicate_;
+			const char* first_; // Start of the underlying range, iteration never reads before it
+			const char* last_; // End of the underlying range, iteration never reads past it
+			predicate_handle predicate_;
+			shared_buffer owner_;
+			std::size_t block_; // Index of the cached 64-byte block counted from first_, or no_block
+			std::uint64_t mask_; // Bit i is set when character i of the cached block is kept
+		};
+
+		// Reverse iterator
+		// Unlike std::reverse_iterator, which copies its base iterator on every dereference, it rests on the character
+		// it refers to, so dereferencing never copies the iterator or touches its reference counts
+		class const_reverse_iterator {
+		 public:
+			using iterator_type = const_iterator;
+			using iterator_concept = std::bidirectional_iterator_tag;
+			using iterator_category = std::bidirectional_iterator_tag;
+			using value_type = char;
+			using difference_type = ptrdiff_t;
+			using pointer = const char*;
+			using reference = const char&;
+
+			const_reverse_iterator() = default;
+			explicit const_reverse_iterator(const_iterator base); // Refers to the kept character before base
+
+			auto base() const -> const_iterator; // The forward iterator one past the character referred to
+
+			auto operator*() const -> reference;
+			auto operator->() const -> pointer;
+			auto operator++() -> const_reverse_iterator&;
+			auto operator++(int) -> const_reverse_iterator;
+			auto operator--() -> const_reverse_iterator&;
+			auto operator--(int) -> const_reverse_iterator;
+			auto operator==(const const_reverse_iterator& other) const -> bool;
+
+		 private:
+			const_iterator current_; // The character referred to, or the first kept character past the end
+			bool past_end_ = false; // Whether the iterator has moved past the first kept character
 		};
 
 		using iterator = const_iterator;
 		using const_iterator = const_iterator;
-		using reverse_iterator = std::reverse_iterator<iterator>;
-		using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+		using reverse_iterator = const_reverse_iterator;
+		using const_reverse_iterator = const_reverse_iterator;
 
 		// 2.10 Range
 		auto begin() const -> const_iterator;
@@ -92,12 +598,259 @@ namespace fsv {
 		auto crend() const -> const_reverse_iterator;
 
 	 private:
+		auto unfiltered() const -> bool; // Whether every character is kept, allowing plain pointer arithmetic
+		auto count_kept() const -> std::size_t; // size, bypassing the cache
+		auto find_kept(int n) const -> const char*; // The nth kept character, or null when there is none
+		auto append_kept(std::string& out) const -> void; // append_to, bypassing the cache
+		auto filled_memo() const -> const detail::memo*; // The filled cache, or null for views that do not memoize
+
 		const char* pointer_; // A constant pointer to the underlying data
 		std::size_t length_; // The length of the string
-		filter predicate_; // Filter
+		predicate_handle predicate_; // Shared handle to the filter, cheap to copy
+		shared_buffer owner_; // The buffer pointer_ points into when the view owns its data
+		detail::intrusive_ptr<detail::memo> memo_; // Shared by copies, null unless the view memoizes
 		static const char default_char; // Default character for invalid index cases
 	};
 
+	// A 16-byte companion of filtered_string_view for storing large numbers of views
+	// It holds the data pointer, a 32-bit length and the id of the interned predicate, and converts back to a full
+	// view with a registry lookup. It never owns the underlying data, not even when made from a view over a
+	// shared_buffer, so the buffer must be kept alive some other way
+	class compact_view {
+	 public:
+		compact_view() noexcept; // An empty, unfiltered view
+		compact_view(const filtered_string_view& fsv); // Throws std::length_error if fsv is longer than 4 GiB
+
+		operator filtered_string_view() const; // Convert back to the full view
+		auto view() const -> filtered_string_view; // Same as the conversion, for use without a cast
+
+		auto data() const noexcept -> const char*; // Return the pointer to the underlying data
+		auto original_size() const noexcept -> std::size_t; // Return the length of the original string
+		auto predicate_id() const noexcept -> std::uint32_t; // Return the id of the interned predicate
+
+	 private:
+		const char* pointer_;
+		std::uint32_t length_;
+		std::uint32_t predicate_id_;
+	};
+
+	// Compact views compare by their filtered contents, like full views
+	auto operator==(const compact_view& lhs, const compact_view& rhs) -> bool;
+	auto operator<=>(const compact_view& lhs, const compact_view& rhs) -> std::strong_ordering;
+
+	// A filtered_string_view together with the offsets of its kept characters, built once in O(n)
+	// Indexing, size and iterator arithmetic are O(1), so algorithms such as std::lower_bound and std::distance run in
+	// logarithmic or constant time instead of walking the view. Copies share the index. Iterators point into the
+	// index, so unlike the view's own iterators they are only valid while a copy of the indexed_view is alive
+	class indexed_view {
+	 public:
+		class const_iterator {
+		 public:
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::random_access_iterator_tag;
+			using value_type = char;
+			using reference = const char&;
+			using pointer = const char*;
+			using difference_type = std::ptrdiff_t;
+
+			const_iterator() = default;
+			const_iterator(const char* base, const std::size_t* position) noexcept
+			: base_(base)
+			, position_(position) {}
+
+			auto operator*() const noexcept -> reference {
+				return base_[*position_];
+			}
+			auto operator->() const noexcept -> pointer {
+				return base_ + *position_;
+			}
+			auto operator[](difference_type n) const noexcept -> reference {
+				return base_[position_[n]];
+			}
+
+			auto operator++() noexcept -> const_iterator& {
+				++position_;
+				return *this;
+			}
+			auto operator++(int) noexcept -> const_iterator {
+				auto copy = *this;
+				++position_;
+				return copy;
+			}
+			auto operator--() noexcept -> const_iterator& {
+				--position_;
+				return *this;
+			}
+			auto operator--(int) noexcept -> const_iterator {
+				auto copy = *this;
+				--position_;
+				return copy;
+			}
+			auto operator+=(difference_type n) noexcept -> const_iterator& {
+				position_ += n;
+				return *this;
+			}
+			auto operator-=(difference_type n) noexcept -> const_iterator& {
+				position_ -= n;
+				return *this;
+			}
+
+			friend auto operator+(const_iterator it, difference_type n) noexcept -> const_iterator {
+				return it += n;
+			}
+			friend auto operator+(difference_type n, const_iterator it) noexcept -> const_iterator {
+				return it += n;
+			}
+			friend auto operator-(const_iterator it, difference_type n) noexcept -> const_iterator {
+				return it -= n;
+			}
+			friend auto operator-(const const_iterator& lhs, const const_iterator& rhs) noexcept -> difference_type {
+				return lhs.position_ - rhs.position_;
+			}
+			friend auto operator==(const const_iterator& lhs, const const_iterator& rhs) noexcept -> bool {
+				return lhs.position_ == rhs.position_;
+			}
+			friend auto operator<=>(const const_iterator& lhs, const const_iterator& rhs) noexcept
+			    -> std::strong_ordering {
+				return lhs.position_ <=> rhs.position_;
+			}
+
+		 private:
+			const char* base_ = nullptr; // The underlying data of the view
+			const std::size_t* position_ = nullptr; // Current entry of the index
+		};
+		using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+		indexed_view(); // An empty, unfiltered view
+		explicit indexed_view(const filtered_string_view& fsv); // Index fsv, testing each character once
+
+		auto operator[](int n) const -> const char&; // The nth kept character, without bounds checking
+		auto at(int index) const -> const char&; // Throws std::domain_error like filtered_string_view::at
+
+		auto size() const noexcept -> std::size_t; // O(1)
+		auto empty() const noexcept -> bool;
+		auto position(std::size_t n) const -> std::size_t; // Offset of the nth kept character in the original string
+		auto view() const noexcept -> const filtered_string_view&; // The indexed view
+
+		auto begin() const noexcept -> const_iterator;
+		auto cbegin() const noexcept -> const_iterator;
+		auto end() const noexcept -> const_iterator;
+		auto cend() const noexcept -> const_iterator;
+		auto rbegin() const noexcept -> const_reverse_iterator;
+		auto crbegin() const noexcept -> const_reverse_iterator;
+		auto rend() const noexcept -> const_reverse_iterator;
+		auto crend() const noexcept -> const_reverse_iterator;
+
+	 private:
+		filtered_string_view view_;
+		std::shared_ptr<const std::vector<std::size_t>> positions_; // Offsets of the kept characters, in order
+	};
+
+	// Build the positions index of fsv, O(n) once
+	auto indexed(const filtered_string_view& fsv) -> indexed_view;
+
+	// A filtered view of a buffer that only grows at the end, such as a log being tailed
+	// extend() filters only the characters added since the previous call and updates the cached count, and the
+	// positions index when enabled, so each call costs time proportional to the new characters. The buffer may move
+	// between calls (a std::string that reallocated, say), but the characters already seen must not change
+	class growing_view {
+	 public:
+		growing_view(); // An empty, unfiltered view
+		explicit growing_view(filter predicate, bool indexed = false);
+		explicit growing_view(predicate_handle predicate, bool indexed = false);
+
+		// Extend the view to the first length characters of data and return the new number of kept characters
+		// Throws std::invalid_argument if length is smaller than the length already seen
+		auto extend(const char* data, std::size_t length) -> std::size_t;
+		auto extend(std::string_view buffer) -> std::size_t;
+
+		auto size() const noexcept -> std::size_t; // O(1)
+		auto empty() const noexcept -> bool;
+		auto original_size() const noexcept -> std::size_t; // Number of characters seen so far
+		auto is_indexed() const noexcept -> bool;
+		// The nth kept character, O(1) when indexed, otherwise like filtered_string_view::operator[]
+		auto operator[](int n) const -> const char&;
+		// Offset of the nth kept character in the buffer; throws std::logic_error if the view is not indexed and
+		// std::out_of_range if n >= size()
+		auto position(std::size_t n) const -> std::size_t;
+		auto view() const -> filtered_string_view; // The characters seen so far, filtered
+
+	 private:
+		const char* pointer_;
+		std::size_t length_;
+		predicate_handle predicate_;
+		std::size_t count_; // Kept characters among the first length_
+		bool indexed_;
+		std::vector<std::size_t> positions_; // Offsets of the kept characters when indexed_
+	};
+
+	// A slab allocator for the storage of filtered_string
+	// Requests of up to max_chunk bytes are rounded up to a power of two and carved out of slab_size slabs. Released
+	// chunks go on a free list per size class and are reused by the next request of that class, so a steady workload
+	// stops allocating once it has warmed up. Larger requests go straight to operator new. Slabs are only returned to
+	// the system when the pool is destroyed, so every string drawn from a pool must be destroyed before it
+	class string_pool {
+	 public:
+		static constexpr std::size_t min_chunk = 16;
+		static constexpr std::size_t max_chunk = 4096;
+		static constexpr std::size_t slab_size = 64 * 1024;
+
+		string_pool() = default;
+		string_pool(const string_pool&) = delete;
+		auto operator=(const string_pool&) -> string_pool& = delete;
+		~string_pool() = default;
+
+		static auto shared() -> string_pool&; // The process-wide pool, which is never destroyed
+
+		auto allocate(std::size_t n) -> char*;
+		auto deallocate(char* p, std::size_t n) noexcept -> void; // n must be the size p was allocated with
+
+		auto slab_bytes() const -> std::size_t; // Bytes held in slabs
+		auto free_bytes() const -> std::size_t; // Bytes of slab space waiting on the free lists
+
+	 private:
+		static constexpr std::size_t class_count = std::bit_width(max_chunk / min_chunk);
+
+		auto push_free(char* chunk, std::size_t size_class) noexcept -> void;
+
+		mutable std::mutex mutex_;
+		std::array<char*, class_count> free_ = {}; // Each free chunk starts with a pointer to the next one
+		std::vector<std::unique_ptr<char[]>> slabs_;
+		char* cursor_ = nullptr; // Unused space left in the newest slab
+		char* slab_end_ = nullptr;
+		std::size_t free_bytes_ = 0;
+	};
+
+	// An owning copy of the kept characters of a view, for results that must outlive the data they were taken from,
+	// such as the pieces of split or the result of substr
+	// The characters are stored NUL-terminated in storage drawn from a string_pool, which they go back to when the
+	// string is destroyed
+	class filtered_string {
+	 public:
+		filtered_string() noexcept; // An empty string, which allocates nothing
+		explicit filtered_string(const filtered_string_view& fsv, string_pool& pool = string_pool::shared());
+		filtered_string(const filtered_string& other);
+		filtered_string(filtered_string&& other) noexcept;
+		auto operator=(const filtered_string& other) -> filtered_string&;
+		auto operator=(filtered_string&& other) noexcept -> filtered_string&;
+		~filtered_string();
+
+		auto size() const noexcept -> std::size_t;
+		auto empty() const noexcept -> bool;
+		auto data() const noexcept -> const char*; // NUL-terminated
+		auto operator[](int n) const -> const char&;
+		auto begin() const noexcept -> const char*;
+		auto end() const noexcept -> const char*;
+		auto view() const -> filtered_string_view; // An unfiltered view of the owned characters
+
+		friend auto operator==(const filtered_string& lhs, const filtered_string& rhs) noexcept -> bool;
+
+	 private:
+		string_pool* pool_;
+		char* data_; // Null when the string is empty
+		std::size_t size_;
+	};
+
 	// 2.7 Operator overloading outside the fsv class
 	auto operator==(const filtered_string_view& lhs, const filtered_string_view& rhs) -> bool; // 2.7.1. Overloading of
 	                                                                                           // ==
@@ -105,13 +858,215 @@ namespace fsv {
 	                 const filtered_string_view& rhs) -> std::strong_ordering; // 2.7.2 Overloading of <=>
 	auto operator<<(std::ostream& os, const filtered_string_view& fsv) -> std::ostream&; // 2.7.3 Overloading of <<
 
+	// Write the kept characters of fsv to the file descriptor fd with writev, straight from the underlying data
+	// Runs of consecutive kept characters become iovec entries, so an unfiltered view is a single entry. Partial writes
+	// and EINTR are retried; any other failure throws std::system_error. Returns the number of bytes written
+	auto write_to(int fd, const filtered_string_view& fsv) -> std::size_t;
+	// Write several views back to back, gathering the runs of all of them into the same writev calls
+	auto write_to(int fd, std::span<const filtered_string_view> views) -> std::size_t;
+
+	// Options for compose
+	struct compose_options {
+		bool adaptive = false; // Reorder the filters that are not byte classes by their sampled cost and selectivity
+		std::size_t sample_size = 1024; // Number of leading characters of the view sampled in adaptive mode
+	};
+
 	// 2.8 Non-Member Utility Functions
-	auto compose(const filtered_string_view& fsv, const std::vector<filter>& filts) -> filtered_string_view; // 2.8.1
-	                                                                                                         // compose
+	auto compose(const filtered_string_view& fsv,
+	             const std::vector<filter>& filts,
+	             const compose_options& options = {}) -> filtered_string_view; // 2.8.1 compose
+	// The order in which a composed view evaluates the filters that are not byte classes, as positions in the
+	// flattened list compose was given. Empty unless the view's predicate composes more than one such filter
+	auto composed_order(const filtered_string_view& fsv) -> std::vector<std::size_t>;
 	auto split(const filtered_string_view& fsv,
 	           const filtered_string_view& tok) -> std::vector<filtered_string_view>; // 2.8.2 split
 	auto substr(const filtered_string_view& fsv, int pos = 0, int count = 0) -> filtered_string_view; // 2.8.3 substr
 
+	namespace detail {
+		// Called with each run of characters a visit function reports, in order
+		using run_callback = void (*)(void* context, const char* first, std::size_t count);
+		// Report every run of kept characters of fsv
+		auto visit_kept_runs(const filtered_string_view& fsv, run_callback fn, void* context) -> void;
+		// Report the span of underlying data of every piece split(fsv, tok) returns
+		auto visit_split_pieces(const filtered_string_view& fsv,
+		                        const filtered_string_view& tok,
+		                        run_callback fn,
+		                        void* context) -> void;
+		// What to reserve to materialise fsv: its size when that is cheap to count, otherwise its original size
+		auto materialized_capacity(const filtered_string_view& fsv) -> std::size_t;
+	} // namespace detail
+
+	// Allocator-aware results
+	// to_string and split draw their result from the given allocator, rebound to the element type, instead of the
+	// global heap, so a caller can place them in a per-request arena. The pieces split returns share fsv's predicate
+	// and allocate nothing themselves
+	template<typename Allocator = std::allocator<char>>
+	auto to_string(const filtered_string_view& fsv, const Allocator& alloc = Allocator())
+	    -> std::basic_string<char,
+	                         std::char_traits<char>,
+	                         typename std::allocator_traits<Allocator>::template rebind_alloc<char>> {
+		using string = std::basic_string<char,
+		                                 std::char_traits<char>,
+		                                 typename std::allocator_traits<Allocator>::template rebind_alloc<char>>;
+		auto result = string(typename string::allocator_type(alloc));
+		result.reserve(detail::materialized_capacity(fsv));
+		detail::visit_kept_runs(
+		    fsv,
+		    [](void* context, const char* first, std::size_t count) {
+			    static_cast<string*>(context)->append(first, count);
+		    },
+		    &result);
+		return result;
+	}
+
+	template<typename Allocator>
+	auto split(const filtered_string_view& fsv, const filtered_string_view& tok, const Allocator& alloc)
+	    -> std::vector<filtered_string_view,
+	                   typename std::allocator_traits<Allocator>::template rebind_alloc<filtered_string_view>> {
+		using pieces =
+		    std::vector<filtered_string_view,
+		                typename std::allocator_traits<Allocator>::template rebind_alloc<filtered_string_view>>;
+		auto result = pieces(typename pieces::allocator_type(alloc));
+		auto context = std::pair<pieces*, const filtered_string_view*>(&result, &fsv);
+		detail::visit_split_pieces(
+		    fsv,
+		    tok,
+		    [](void* context, const char* first, std::size_t count) {
+			    const auto [out, whole] = *static_cast<std::pair<pieces*, const filtered_string_view*>*>(context);
+			    out->emplace_back(first, count, whole->shared_predicate(), whole->owner());
+		    },
+		    &context);
+		return result;
+	}
+
+	// std::pmr versions of the above, drawing from resource
+	namespace pmr {
+		auto to_string(const filtered_string_view& fsv,
+		               std::pmr::memory_resource* resource = std::pmr::get_default_resource()) -> std::pmr::string;
+		auto split(const filtered_string_view& fsv,
+		           const filtered_string_view& tok,
+		           std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		    -> std::pmr::vector<filtered_string_view>;
+	} // namespace pmr
+
+	// Bitmask views
+	// masked evaluates a view's predicate once and returns a view over the same characters whose selection is a packed
+	// bitmask. The set operations combine the selections of two views over the same characters word by word, without
+	// calling any predicate, and return bitmask views; they throw std::invalid_argument if the views cover different
+	// characters. Bitmask views test characters by address, so they keep nothing outside the range they were made for
+	auto masked(const filtered_string_view& fsv) -> filtered_string_view;
+	auto mask_and(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view;
+	auto mask_or(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view;
+	auto mask_xor(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view;
+	auto mask_not(const filtered_string_view& fsv) -> filtered_string_view; // Keeps exactly what fsv rejects
+
+	// What scan produces besides the counts
+	struct scan_options {
+		bool masks = false; // Record which characters each filter keeps
+		bool strings = false; // Copy out the characters each filter keeps
+	};
+
+	// The result of scanning one buffer with several filters, indexed like the filters
+	struct scan_result {
+		std::vector<std::size_t> counts; // Number of characters each filter keeps
+		std::vector<std::vector<std::uint64_t>> masks; // Bit i of word w is set when data[64 * w + i] is kept
+		std::vector<std::string> strings; // The kept characters, as filtered_string_view would convert to std::string
+	};
+
+	// Evaluate every filter over data in a single pass, instead of one pass per filtered view
+	// The buffer is read 64 bytes at a time and every filter tests the block while it is still in cache. Byte
+	// classes are tested with a table lookup, as in a view
+	auto scan(std::string_view data, const std::vector<filter>& filts, const scan_options& options = {})
+	    -> scan_result;
+
+	// A column of strings stored back to back, in the offsets-plus-buffer layout used by columnar formats
+	// Row i is data[offsets[i], offsets[i + 1]), so n rows need n + 1 non-decreasing offsets
+	struct string_column {
+		std::string_view data;
+		std::span<const std::size_t> offsets;
+	};
+
+	// The filtered rows of a string_column, in the same layout but owning its buffers
+	struct filtered_column {
+		std::string data; // The kept characters of every row, back to back
+		std::vector<std::size_t> offsets; // Row i is data[offsets[i], offsets[i + 1])
+
+		auto rows() const noexcept -> std::size_t;
+		auto operator[](std::size_t row) const -> std::string_view;
+	};
+
+	// Options for filter_column
+	struct batch_options {
+		std::size_t threads = 0; // Upper bound on worker threads, 0 uses std::thread::hardware_concurrency
+	};
+
+	// Filter every row of column with one predicate into a single output buffer
+	// The predicate is tested once per byte, 64 bytes at a time, without building a view or a string per row. Large
+	// columns are split between threads, so a generic predicate must be safe to call concurrently. Throws
+	// std::out_of_range if the offsets are decreasing or reach past the end of the data
+	auto filter_column(const string_column& column,
+	                   const predicate_handle& predicate,
+	                   const batch_options& options = {}) -> filtered_column;
+	auto filter_column(const string_column& column,
+	                   const filter& predicate,
+	                   const batch_options& options = {}) -> filtered_column;
+
+	// Counters of a string_cache
+	struct cache_stats {
+		std::uint64_t hits = 0;
+		std::uint64_t misses = 0;
+		std::uint64_t evictions = 0;
+		std::size_t entries = 0;
+		auto hit_rate() const noexcept -> double; // hits / (hits + misses), 0 before the first lookup
+	};
+
+	// A bounded cache of materialised views, shared between threads
+	// Results are keyed by the data pointer, length and predicate of the view, and shared as immutable strings. Each
+	// entry holds on to its predicate and, for views over a shared_buffer, to the buffer, which are released when the
+	// entry is evicted. The keys are spread over shards that each have their own lock and evict with the CLOCK
+	// algorithm, and views are materialised outside the lock. The cache cannot tell when non-owned characters at a
+	// cached address change: after such data is modified, or freed and its memory reused, get() keeps returning the
+	// old result until the range is invalidated
+	class string_cache {
+	 public:
+		static constexpr std::size_t default_capacity = 4096;
+		static constexpr std::size_t default_max_size = 64 * 1024;
+
+		explicit string_cache(std::size_t capacity = default_capacity, std::size_t max_size = default_max_size);
+		string_cache(const string_cache&) = delete;
+		auto operator=(const string_cache&) -> string_cache& = delete;
+		~string_cache();
+
+		static auto global() -> string_cache&; // The process-wide cache, which is never destroyed
+
+		// The kept characters of fsv, materialised on a miss. Results longer than max_size are returned uncached
+		auto get(const filtered_string_view& fsv) -> std::shared_ptr<const std::string>;
+		// Drop the entries for views overlapping [data, data + length) and return how many there were
+		auto invalidate(const char* data, std::size_t length) -> std::size_t;
+		auto clear() -> void;
+		auto stats() const -> cache_stats;
+		auto capacity() const noexcept -> std::size_t; // At most this many results are cached
+
+	 private:
+		struct shard;
+
+		std::size_t max_size_;
+		std::size_t shard_count_;
+		std::unique_ptr<shard[]> shards_;
+	};
+
+	// Look fsv up in string_cache::global()
+	auto cached_string(const filtered_string_view& fsv) -> std::shared_ptr<const std::string>;
+
 } // namespace fsv
 
+// A filtered_string_view is a cheap-to-copy, non-owning view, and its iterators do not depend on the view object
+template<>
+inline constexpr bool std::ranges::enable_view<fsv::filtered_string_view> = true;
+template<>
+inline constexpr bool std::ranges::enable_borrowed_range<fsv::filtered_string_view> = true;
+// An indexed_view is cheap to copy, but its iterators point into the index it owns
+template<>
+inline constexpr bool std::ranges::enable_view<fsv::indexed_view> = true;
+
 #endif // COMP6771_ASS2_FSV_H
@@ -0,0 +1,228 @@
+#include "./filtered_string_view.kernels.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <string_view>
+
+#if (defined(__x86_64__) or defined(__i386__)) and defined(__GNUC__)
+#define FSV_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define FSV_X86_KERNELS 0
+#endif
+
+namespace fsv {
+	namespace detail {
+		auto make_simd_table(const byte_class& cls) -> simd_table {
+			auto table = simd_table{};
+			for (auto b = 0; b < 256; ++b) {
+				if (not cls.contains(static_cast<char>(b))) {
+					continue;
+				}
+				auto& row = b < 128 ? table.low : table.high;
+				row[static_cast<std::size_t>(b % 16)] |= static_cast<std::uint8_t>(1U << ((b / 16) % 8));
+			}
+
+			// Record the runs of consecutive members, giving up after three
+			table.ranged = true;
+			for (auto b = 0; b < 256;) {
+				if (not cls.contains(static_cast<char>(b))) {
+					++b;
+					continue;
+				}
+				const auto first = b;
+				while (b < 256 and cls.contains(static_cast<char>(b))) {
+					++b;
+				}
+				if (table.range_count == table.ranges.size()) {
+					table.ranged = false;
+					break;
+				}
+				const auto last = b - 1;
+				table.ranges[table.range_count++] = {static_cast<std::uint8_t>(first), static_cast<std::uint8_t>(last)};
+			}
+			return table;
+		}
+	} // namespace detail
+
+	namespace {
+		auto classify_scalar(const detail::simd_table& table, const char* p) -> std::uint64_t {
+			auto mask = std::uint64_t{0};
+			for (std::size_t i = 0; i < 64; ++i) {
+				const auto b = static_cast<unsigned char>(p[i]);
+				const auto row = b < 128 ? table.low[b % 16] : table.high[b % 16];
+				mask |= static_cast<std::uint64_t>((row >> (b / 16 % 8)) & 1U) << i;
+			}
+			return mask;
+		}
+
+#if FSV_X86_KERNELS
+		[[gnu::target("sse2")]] auto load_row(const std::array<std::uint8_t, 16>& row) -> __m128i {
+			return _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.data()));
+		}
+
+		// SSE2 has no byte shuffle, so it can only test a class range by range: b is in [first, last] exactly when
+		// b - first <= last - first as unsigned bytes
+		[[gnu::target("sse2")]] auto classify_sse2(const detail::simd_table& table, const char* p) -> std::uint64_t {
+			if (not table.ranged) {
+				return classify_scalar(table, p);
+			}
+			auto mask = std::uint64_t{0};
+			for (auto chunk = 0; chunk < 4; ++chunk) {
+				const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * chunk));
+				auto hit = _mm_setzero_si128();
+				for (std::size_t r = 0; r < table.range_count; ++r) {
+					const auto [first, last] = table.ranges[r];
+					const auto offset = _mm_sub_epi8(x, _mm_set1_epi8(static_cast<char>(first)));
+					const auto span = _mm_set1_epi8(static_cast<char>(last - first));
+					hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_max_epu8(offset, span), span));
+				}
+				mask |= std::uint64_t{static_cast<std::uint16_t>(_mm_movemask_epi8(hit))} << (16 * chunk);
+			}
+			return mask;
+		}
+
+		// The nibble lookup: the low nibble of b picks a row of the table, the high nibble picks a bit of that row
+		[[gnu::target("sse4.2")]] auto classify_sse42(const detail::simd_table& table, const char* p) -> std::uint64_t {
+			const auto low = load_row(table.low);
+			const auto high = load_row(table.high);
+			const auto bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+			const auto nibble = _mm_set1_epi8(0x0f);
+
+			auto mask = std::uint64_t{0};
+			for (auto chunk = 0; chunk < 4; ++chunk) {
+				const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * chunk));
+				const auto lo = _mm_and_si128(x, nibble);
+				const auto hi = _mm_and_si128(_mm_srli_epi16(x, 4), nibble);
+				const auto rows = _mm_blendv_epi8(_mm_shuffle_epi8(low, lo),
+				                                  _mm_shuffle_epi8(high, lo),
+				                                  _mm_cmpgt_epi8(hi, _mm_set1_epi8(7)));
+				const auto bit = _mm_shuffle_epi8(bits, hi);
+				const auto hit = _mm_cmpeq_epi8(_mm_and_si128(rows, bit), bit);
+				mask |= std::uint64_t{static_cast<std::uint16_t>(_mm_movemask_epi8(hit))} << (16 * chunk);
+			}
+			return mask;
+		}
+
+		[[gnu::target("avx2")]] auto classify_avx2(const detail::simd_table& table, const char* p) -> std::uint64_t {
+			const auto low = _mm256_broadcastsi128_si256(load_row(table.low));
+			const auto high = _mm256_broadcastsi128_si256(load_row(table.high));
+			const auto bits = _mm256_broadcastsi128_si256(
+			    _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128));
+			const auto nibble = _mm256_set1_epi8(0x0f);
+
+			auto mask = std::uint64_t{0};
+			for (auto chunk = 0; chunk < 2; ++chunk) {
+				const auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * chunk));
+				const auto lo = _mm256_and_si256(x, nibble);
+				const auto hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+				const auto rows = _mm256_blendv_epi8(_mm256_shuffle_epi8(low, lo),
+				                                     _mm256_shuffle_epi8(high, lo),
+				                                     _mm256_cmpgt_epi8(hi, _mm256_set1_epi8(7)));
+				const auto bit = _mm256_shuffle_epi8(bits, hi);
+				const auto hit = _mm256_cmpeq_epi8(_mm256_and_si256(rows, bit), bit);
+				mask |= std::uint64_t{static_cast<std::uint32_t>(_mm256_movemask_epi8(hit))} << (32 * chunk);
+			}
+			return mask;
+		}
+
+		[[gnu::target("avx512f,avx512bw")]] auto classify_avx512(const detail::simd_table& table, const char* p)
+		    -> std::uint64_t {
+			// The zero-masked broadcast copies each 16-byte row into all four 128-bit lanes
+			constexpr auto all_lanes = __mmask16{0xffff};
+			const auto low = _mm512_maskz_broadcast_i32x4(all_lanes, load_row(table.low));
+			const auto high = _mm512_maskz_broadcast_i32x4(all_lanes, load_row(table.high));
+			const auto bits = _mm512_maskz_broadcast_i32x4(
+			    all_lanes,
+			    _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128));
+			const auto nibble = _mm512_set1_epi8(0x0f);
+
+			const auto x = _mm512_loadu_si512(p);
+			const auto lo = _mm512_and_si512(x, nibble);
+			const auto hi = _mm512_and_si512(_mm512_srli_epi16(x, 4), nibble);
+			const auto rows = _mm512_mask_blend_epi8(_mm512_cmpgt_epi8_mask(hi, _mm512_set1_epi8(7)),
+			                                         _mm512_shuffle_epi8(low, lo),
+			                                         _mm512_shuffle_epi8(high, lo));
+			return _mm512_test_epi8_mask(rows, _mm512_shuffle_epi8(bits, hi));
+		}
+#endif
+
+		constexpr auto kernel_sets = std::array<detail::kernel_set, 5>{{
+		    {simd_level::scalar, classify_scalar},
+#if FSV_X86_KERNELS
+		    {simd_level::sse2, classify_sse2},
+		    {simd_level::sse42, classify_sse42},
+		    {simd_level::avx2, classify_avx2},
+		    {simd_level::avx512, classify_avx512},
+#else
+		    {simd_level::sse2, classify_scalar},
+		    {simd_level::sse42, classify_scalar},
+		    {simd_level::avx2, classify_scalar},
+		    {simd_level::avx512, classify_scalar},
+#endif
+		}};
+
+		auto detect_simd_level() -> simd_level {
+#if FSV_X86_KERNELS
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512bw")) {
+				return simd_level::avx512;
+			}
+			if (__builtin_cpu_supports("avx2")) {
+				return simd_level::avx2;
+			}
+			if (__builtin_cpu_supports("sse4.2")) {
+				return simd_level::sse42;
+			}
+			if (__builtin_cpu_supports("sse2")) {
+				return simd_level::sse2;
+			}
+#endif
+			return simd_level::scalar;
+		}
+
+		auto forced_scalar() -> bool {
+			const auto* value = std::getenv("FSV_FORCE_SCALAR");
+			return value != nullptr and *value != '\0' and std::string_view(value) != "0";
+		}
+
+		constinit auto active = std::atomic<const detail::kernel_set*>(nullptr);
+	} // namespace
+
+	auto detail::active_kernels() -> const kernel_set& {
+		if (const auto* kernels = active.load(std::memory_order_acquire)) {
+			return *kernels;
+		}
+		// Racing first calls pick the same kernels, so whichever store lands is fine
+		const auto level = forced_scalar() ? simd_level::scalar : supported_simd_level();
+		const auto* kernels = &kernel_sets[static_cast<std::size_t>(level)];
+		active.store(kernels, std::memory_order_release);
+		return *kernels;
+	}
+
+	auto supported_simd_level() -> simd_level {
+		static const auto level = detect_simd_level();
+		return level;
+	}
+
+	auto active_simd_level() -> simd_level {
+		return detail::active_kernels().level;
+	}
+
+	auto use_simd_level(simd_level level) -> simd_level {
+		level = std::min(level, supported_simd_level());
+		active.store(&kernel_sets[static_cast<std::size_t>(level)], std::memory_order_release);
+		return level;
+	}
+
+	auto simd_level_name(simd_level level) -> const char* {
+		switch (level) {
+		case simd_level::scalar: return "scalar";
+		case simd_level::sse2: return "SSE2";
+		case simd_level::sse42: return "SSE4.2";
+		case simd_level::avx2: return "AVX2";
+		case simd_level::avx512: return "AVX-512BW";
+		}
+		return "unknown";
+	}
+} // namespace fsv
@@ -0,0 +1,25 @@
+#ifndef COMP6771_ASS2_FSV_KERNELS_H
+#define COMP6771_ASS2_FSV_KERNELS_H
+
+#include "./filtered_string_view.h"
+
+#include <cstdint>
+
+// The SIMD kernels behind byte-class scans, internal to the library
+// Each kernel exists once per simd_level and is reached through the kernel_set selected for the running CPU
+namespace fsv {
+	namespace detail {
+		// Return the keep mask of the 64 characters at p: bit i is set when the class keeps p[i]
+		using classify_kernel = std::uint64_t (*)(const simd_table& table, const char* p);
+
+		struct kernel_set {
+			simd_level level;
+			classify_kernel classify;
+		};
+
+		auto make_simd_table(const byte_class& cls) -> simd_table;
+		auto active_kernels() -> const kernel_set&; // Selects the kernels on first use
+	} // namespace detail
+} // namespace fsv
+
+#endif // COMP6771_ASS2_FSV_KERNELS_H
@@ -1,11 +1,17 @@
 #include "./filtered_string_view.h"
 
 #include <catch2/catch.hpp>
+#include <cstdio>
 #include <functional>
 #include <iostream>
+#include <memory_resource>
+#include <ranges>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
+
+#include <unistd.h>
 
 // 2.3 Check whether the default predicate function returns true for all characters
 TEST_CASE("Default predicate returns true for all chars") {
@@ -91,6 +97,100 @@ TEST_CASE("Filtered_string_view constructed from C-style string with predicate -
 	REQUIRE(static_cast<std::string>(sv) == "eae");
 }
 
+TEST_CASE("Explicit default predicate is recognised as the identity filter") {
+	auto s = std::string{"husky"};
+	auto sv = fsv::filtered_string_view{s, fsv::filtered_string_view::default_predicate};
+
+	REQUIRE(sv.shared_predicate().is_default());
+	REQUIRE(sv.shared_predicate().use_count() == 0); // No state was allocated for it
+	REQUIRE(sv.size() == 5);
+	REQUIRE(sv[4] == 'y');
+	REQUIRE(sv[5] == '\0');
+	REQUIRE(static_cast<std::string>(sv) == "husky");
+}
+
+TEST_CASE("Tabulate evaluates a pure predicate once per byte value") {
+	auto calls = 0;
+	auto is_vowel = [&calls](const char& c) {
+		++calls;
+		return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+	};
+
+	const auto table = fsv::tabulate(is_vowel);
+	REQUIRE(calls == 256);
+	REQUIRE(table == fsv::byte_class::of("aeiou"));
+}
+
+TEST_CASE("Tabulated views never call the predicate after construction") {
+	auto calls = 0;
+	auto not_space = [&calls](const char& c) {
+		++calls;
+		return c != ' ';
+	};
+	auto sv = fsv::filtered_string_view{"Great Dane", not_space, fsv::tabulated};
+	calls = 0;
+
+	REQUIRE(sv.predicate().target<fsv::byte_class>() != nullptr);
+	REQUIRE(sv.size() == 9);
+	REQUIRE(static_cast<std::string>(sv) == "GreatDane");
+	REQUIRE(fsv::substr(sv, 5, 2) == fsv::filtered_string_view{"Da"});
+	REQUIRE(std::string(sv.begin(), sv.end()) == "GreatDane");
+	REQUIRE(calls == 0);
+}
+
+// Length-bounded constructors
+TEST_CASE("Length-bounded views stop at their length, not at a NUL") {
+	const char buffer[] = {'p', 'u', 'g', 'X', 'X'}; // Not NUL-terminated
+	auto sv = fsv::filtered_string_view{buffer, 3};
+
+	REQUIRE(sv.size() == 3);
+	REQUIRE(static_cast<std::string>(sv) == "pug");
+	REQUIRE(std::string(sv.begin(), sv.end()) == "pug");
+	REQUIRE(std::string(sv.rbegin(), sv.rend()) == "gup");
+	REQUIRE(sv[3] == '\0');
+	REQUIRE_THROWS_AS(sv.at(3), std::domain_error);
+}
+
+TEST_CASE("Length-bounded views keep embedded NULs") {
+	using namespace std::string_literals;
+	auto s = "a\0b\0c"s;
+	auto sv = fsv::filtered_string_view{std::string_view(s), [](const char& c) { return c != 'b'; }};
+
+	REQUIRE(sv.size() == 4);
+	REQUIRE(static_cast<std::string>(sv) == "a\0\0c"s);
+	REQUIRE(sv.at(3) == 'c');
+	REQUIRE(std::distance(sv.begin(), sv.end()) == 4);
+}
+
+TEST_CASE("string_view Constructor views the same data") {
+	auto s = std::string{"whippet"};
+	auto sv = fsv::filtered_string_view{std::string_view(s).substr(2, 3)};
+
+	REQUIRE(sv.data() == s.data() + 2);
+	REQUIRE(sv.original_size() == 3);
+	REQUIRE(static_cast<std::string>(sv) == "ipp");
+}
+
+// Binary Data Constructors
+TEST_CASE("Views a vector of bytes in place") {
+	auto frame = std::vector<std::uint8_t>{0x02, 'G', 0x00, 'E', 'T', 0x03};
+	auto printable = [](const char& c) { return c >= ' ' and c <= '~'; };
+	auto sv = fsv::filtered_string_view{frame, printable};
+
+	REQUIRE(static_cast<const void*>(sv.data()) == static_cast<const void*>(frame.data()));
+	REQUIRE(sv.original_size() == frame.size());
+	REQUIRE(static_cast<std::string>(sv) == "GET");
+}
+
+TEST_CASE("Views a span of std::byte without a predicate") {
+	const std::byte payload[] = {std::byte{'o'}, std::byte{0}, std::byte{'k'}};
+	auto sv = fsv::filtered_string_view{std::span<const std::byte>(payload)};
+
+	REQUIRE(sv.size() == 3); // The embedded NUL is part of the view
+	REQUIRE(sv[2] == 'k');
+	REQUIRE(fsv::substr(sv, 2) == fsv::filtered_string_view{"k"});
+}
+
 // 2.4.6 Copy and Move Constructor
 TEST_CASE("Copy constructor shares the same data") {
 	auto sv1 = fsv::filtered_string_view{"bulldog"};
@@ -100,6 +200,41 @@ TEST_CASE("Copy constructor shares the same data") {
 	                                    // object
 }
 
+TEST_CASE("Copies share the predicate instead of copying it") {
+	auto big_capture = std::vector<char>{'a', 'e', 'i', 'o', 'u'};
+	auto sv1 = fsv::filtered_string_view{"sheepdog", [big_capture](const char& c) {
+		                                     return std::ranges::find(big_capture, c) != big_capture.end();
+	                                     }};
+	const auto copy = sv1;
+
+	REQUIRE(copy.shared_predicate() == sv1.shared_predicate());
+	REQUIRE(sv1.shared_predicate().use_count() == 2);
+	REQUIRE(static_cast<std::string>(copy) == "eeo");
+}
+
+TEST_CASE("Unfiltered views share the default predicate") {
+	auto sv1 = fsv::filtered_string_view{"beagle"};
+	auto sv2 = fsv::filtered_string_view{std::string{"pug"}};
+
+	REQUIRE(sv1.shared_predicate() == sv2.shared_predicate());
+	REQUIRE(sv1.shared_predicate().use_count() == 0); // The default predicate is never reference counted
+}
+
+TEST_CASE("Predicate handle outlives the view it came from") {
+	auto handle = fsv::predicate_handle{};
+	{
+		auto sv = fsv::filtered_string_view{"terrier", [](const char& c) { return c == 'r'; }};
+		handle = sv.shared_predicate();
+	}
+
+	REQUIRE(handle.use_count() == 1);
+	REQUIRE(handle('r'));
+	REQUIRE_FALSE(handle('t'));
+
+	auto sv = fsv::filtered_string_view{"border", handle};
+	REQUIRE(static_cast<std::string>(sv) == "rr");
+}
+
 TEST_CASE("Move constructor transfers ownership correctly") {
 	auto sv1 = fsv::filtered_string_view{"bulldog"};
 	const auto move = std::move(sv1); // Use std::move to move
@@ -108,6 +243,50 @@ TEST_CASE("Move constructor transfers ownership correctly") {
 	REQUIRE(static_cast<int>(sv1.size()) == 0);
 }
 
+// Compact view
+TEST_CASE("Compact view is 16 bytes and round-trips to a full view") {
+	STATIC_REQUIRE(sizeof(fsv::compact_view) == 16);
+
+	auto pred = [](const char& c) { return c != 'o'; };
+	auto sv = fsv::filtered_string_view{"poodle", pred};
+	auto compact = fsv::compact_view{sv};
+
+	REQUIRE(compact.data() == sv.data());
+	REQUIRE(compact.original_size() == 6);
+	REQUIRE(compact.predicate_id() != 0);
+	REQUIRE(compact.predicate_id() == fsv::compact_view{sv}.predicate_id()); // Interning is idempotent
+
+	auto full = static_cast<fsv::filtered_string_view>(compact);
+	REQUIRE(full.shared_predicate() == sv.shared_predicate());
+	REQUIRE(static_cast<std::string>(full) == "pdle");
+}
+
+TEST_CASE("Compact views of unfiltered views use the reserved id") {
+	auto compact = fsv::compact_view{fsv::filtered_string_view{"boxer"}};
+
+	REQUIRE(compact.predicate_id() == 0);
+	REQUIRE(compact.view().shared_predicate().is_default());
+	REQUIRE(compact == fsv::compact_view{fsv::filtered_string_view{"boxer"}});
+	REQUIRE(compact < fsv::compact_view{fsv::filtered_string_view{"corgi"}});
+}
+
+TEST_CASE("Compact views reject views too long for a 32-bit length before interning the predicate") {
+	if constexpr (sizeof(std::size_t) > sizeof(std::uint32_t)) {
+		// The view is never read, only measured
+		const auto* text = "Bernedoodle";
+		const auto length = std::size_t{std::numeric_limits<std::uint32_t>::max()} + 1;
+		const auto predicate = fsv::predicate_handle([](const char& c) { return c != 'o'; });
+		const auto sv = fsv::filtered_string_view(text, length, predicate);
+
+		REQUIRE_THROWS_AS(fsv::compact_view{sv}, std::length_error);
+		REQUIRE(predicate.use_count() == 2); // The registry did not take a reference
+	}
+}
+
+TEST_CASE("Unknown predicate ids are rejected") {
+	REQUIRE_THROWS_AS(fsv::predicate_handle::from_id(std::numeric_limits<std::uint32_t>::max()), std::out_of_range);
+}
+
 // 2.5.2 Overloading of =
 TEST_CASE("filtered_string_view operator==") {
 	auto pred = [](const char& c) { return c == '4' || c == '2'; };
@@ -277,6 +456,19 @@ TEST_CASE("Spaceship operator for filtered_string_view") {
 	REQUIRE((lo <=> hi == std::strong_ordering::less));
 }
 
+TEST_CASE("Filtered and unfiltered comparisons agree on ordering") {
+	auto always = [](const char&) { return true; };
+	auto lo = fsv::filtered_string_view{"abc"};
+	auto hi = fsv::filtered_string_view{"ab\xff"};
+	auto lo_filtered = fsv::filtered_string_view{"abc", always};
+	auto hi_filtered = fsv::filtered_string_view{"ab\xff", always};
+
+	REQUIRE((lo <=> hi) == std::strong_ordering::less); // Characters compare as unsigned, like std::string
+	REQUIRE((lo_filtered <=> hi_filtered) == std::strong_ordering::less);
+	REQUIRE((lo_filtered <=> lo) == std::strong_ordering::equal);
+	REQUIRE(lo_filtered == lo);
+}
+
 // // 2.7.3 Overloading of <<
 TEST_CASE("Output operator for filtered_string_view") {
 	fsv::filtered_string_view fsv("c++ > rust > java", [](const char& c) { return c == 'c' || c == '+'; });
@@ -287,6 +479,13 @@ TEST_CASE("Output operator for filtered_string_view") {
 	REQUIRE(ss.str() == "c++");
 }
 
+TEST_CASE("Output operator for an unfiltered view") {
+	auto sv = fsv::filtered_string_view{"shiba inu"};
+	std::stringstream ss;
+	ss << sv;
+	REQUIRE(ss.str() == "shiba inu");
+}
+
 // 2.8.1 compose
 TEST_CASE("Compose function combines multiple filters") {
 	fsv::filtered_string_view best_languages{"c / c++"};
@@ -316,6 +515,75 @@ TEST_CASE("Compose function with all true filters") {
 	REQUIRE(ss.str() == "c / c++");
 }
 
+TEST_CASE("Byte classes match the <cctype> functions in the C locale") {
+	for (int b = 0; b < 256; ++b) {
+		const auto c = static_cast<char>(b);
+		const auto u = static_cast<unsigned char>(b);
+		CHECK(fsv::classes::alpha.contains(c) == (std::isalpha(u) != 0));
+		CHECK(fsv::classes::digit.contains(c) == (std::isdigit(u) != 0));
+		CHECK(fsv::classes::space.contains(c) == (std::isspace(u) != 0));
+		CHECK(fsv::classes::punct.contains(c) == (std::ispunct(u) != 0));
+		CHECK(fsv::classes::xdigit.contains(c) == (std::isxdigit(u) != 0));
+	}
+	REQUIRE(fsv::byte_class::all().count() == 256);
+	REQUIRE(fsv::byte_class().count() == 0);
+}
+
+TEST_CASE("Compose folds byte classes into a single table") {
+	fsv::filtered_string_view sv{"Rex, 3 years; Fido, 12 years"};
+	auto vf = std::vector<fsv::filter>{fsv::classes::alnum, ~fsv::classes::upper, fsv::byte_class::range('0', 'z')};
+
+	auto composed = fsv::compose(sv, vf);
+	const auto* table = composed.predicate().target<fsv::byte_class>();
+	REQUIRE(table != nullptr); // No per-filter calls are left
+	REQUIRE(*table == (fsv::classes::digit | fsv::classes::lower));
+	REQUIRE(static_cast<std::string>(composed) == "ex3yearsido12years");
+}
+
+TEST_CASE("Compose flattens nested compositions") {
+	fsv::filtered_string_view sv{"a1-b2-C3"};
+	auto not_dash = [](const char& c) { return c != '-'; };
+	auto not_b = [](const char& c) { return c != 'b'; };
+
+	auto inner = fsv::compose(sv, {not_dash, fsv::classes::alnum});
+	auto outer = fsv::compose(sv, {inner.predicate(), not_b, fsv::classes::lower | fsv::classes::digit});
+
+	REQUIRE(static_cast<std::string>(outer) == "a123");
+	auto nested_again = fsv::compose(sv, {outer.predicate()});
+	REQUIRE(static_cast<std::string>(nested_again) == "a123");
+}
+
+TEST_CASE("Adaptive compose evaluates the most selective filter first") {
+	auto text = std::string(4096, 'x');
+	text[100] = 'y';
+	fsv::filtered_string_view sv{text};
+	auto keeps_nearly_everything = [](const char& c) { return c != '\x01'; };
+	auto rejects_most = [](const char& c) { return c == 'y'; };
+
+	auto given = fsv::compose(sv, {keeps_nearly_everything, rejects_most});
+	REQUIRE(fsv::composed_order(given) == std::vector<std::size_t>{0, 1});
+
+	auto adaptive = fsv::compose(sv, {keeps_nearly_everything, rejects_most}, {.adaptive = true, .sample_size = 512});
+	REQUIRE(fsv::composed_order(adaptive) == std::vector<std::size_t>{1, 0});
+	REQUIRE(static_cast<std::string>(adaptive) == "y");
+}
+
+TEST_CASE("Composed order is empty for views that are not compositions") {
+	REQUIRE(fsv::composed_order(fsv::filtered_string_view{"pointer"}).empty());
+	auto sv = fsv::compose(fsv::filtered_string_view{"setter"}, {fsv::classes::lower, fsv::classes::alpha});
+	REQUIRE(fsv::composed_order(sv).empty());
+}
+
+TEST_CASE("Compose keeps the original length of the view") {
+	auto s = std::string{"dalmatian"};
+	auto sv = fsv::filtered_string_view{std::string_view(s).substr(0, 4)};
+	auto composed = fsv::compose(sv, {[](const char& c) { return c != 'a'; }});
+
+	REQUIRE(composed.data() == s.data());
+	REQUIRE(composed.original_size() == 4);
+	REQUIRE(static_cast<std::string>(composed) == "dlm");
+}
+
 // 2.8.2 split
 TEST_CASE("Split with mixed case and special characters") {
 	auto interest = std::set<char>{'a', 'A', 'b', 'B', 'c', 'C', 'd', 'D', 'e', 'E', 'f', 'F', ' ', '/'};
@@ -381,6 +649,17 @@ TEST_CASE("Split with no delimiter in string") {
 	CHECK(v == expected);
 }
 
+TEST_CASE("Split pieces view the original data") {
+	auto s = std::string{"lab,pug,pom"};
+	auto sv = fsv::filtered_string_view{s};
+	auto v = fsv::split(sv, ",");
+
+	REQUIRE(v.size() == 3);
+	REQUIRE(v[1].data() == s.data() + 4);
+	REQUIRE(v[1].original_size() == 3);
+	REQUIRE(v == std::vector<fsv::filtered_string_view>{"lab", "pug", "pom"});
+}
+
 // 2.8.3 substr
 TEST_CASE("Substr function extracts part of the string correctly") {
 	fsv::filtered_string_view sv{"Siberian Husky"};
@@ -438,6 +717,18 @@ TEST_CASE("Substr function extracts middle part of the string") {
 	REQUIRE(ss.str() == "Mala");
 }
 
+TEST_CASE("Substr views the original data and keeps the predicate") {
+	auto s = std::string{"Bernese Mountain Dog"};
+	auto sv = fsv::filtered_string_view{s, [](const char& c) { return c != ' '; }};
+	auto result = fsv::substr(sv, 7, 8);
+
+	REQUIRE(result.data() >= s.data() + 7);
+	REQUIRE(result.data() + result.original_size() <= s.data() + s.size());
+	REQUIRE(result.shared_predicate() == sv.shared_predicate());
+	REQUIRE(static_cast<std::string>(result) == "Mountain");
+	REQUIRE(fsv::substr(result, 1, 3) == fsv::filtered_string_view{"oun"});
+}
+
 // 2.9 迭代器
 TEST_CASE("Default predicate iteration") {
 	auto print_via_iterator = [](const fsv::filtered_string_view& sv) {
@@ -582,4 +873,916 @@ TEST_CASE("Using const_reverse_iterator") {
 	REQUIRE(*crit == 'i');
 	++crit;
 	REQUIRE(*crit == 'h');
-}
\ No newline at end of file
+}
+// Ranges
+TEST_CASE("filtered_string_view models a borrowed bidirectional view") {
+	using iterator = fsv::filtered_string_view::const_iterator;
+	STATIC_REQUIRE(std::bidirectional_iterator<iterator>);
+	STATIC_REQUIRE(std::sentinel_for<std::default_sentinel_t, iterator>);
+	STATIC_REQUIRE(std::ranges::bidirectional_range<fsv::filtered_string_view>);
+	STATIC_REQUIRE(std::ranges::common_range<fsv::filtered_string_view>);
+	STATIC_REQUIRE(std::ranges::view<fsv::filtered_string_view>);
+	STATIC_REQUIRE(std::ranges::borrowed_range<fsv::filtered_string_view>);
+}
+
+TEST_CASE("Range adaptors compose with filtered_string_view") {
+	auto s = std::string{"Cavalier King Charles"};
+	auto is_upper = [](const char& c) { return std::isupper(static_cast<unsigned char>(c)) != 0; };
+	auto lowered = fsv::filtered_string_view{s, is_upper}
+	               | std::views::transform([](char c) { return static_cast<char>(std::tolower(c)); })
+	               | std::views::take(2);
+
+	REQUIRE(std::ranges::equal(lowered, std::string{"ck"}));
+	REQUIRE(std::ranges::equal(fsv::filtered_string_view{s, is_upper} | std::views::reverse, std::string{"CKC"}));
+}
+
+TEST_CASE("Iterators outlive the view they came from") {
+	auto s = std::string{"Basenji"};
+	// Borrowed ranges do not produce std::ranges::dangling, even for a temporary view
+	auto it = std::ranges::find(fsv::filtered_string_view{s, [](const char& c) { return c != 'a'; }}, 'n');
+
+	REQUIRE(*it == 'n');
+	++it;
+	REQUIRE(*it == 'j');
+	++it;
+	REQUIRE(*it == 'i');
+	++it;
+	REQUIRE(it == std::default_sentinel);
+}
+
+TEST_CASE("Byte-class iterators step across 64-byte blocks") {
+	// Kept digits sit on both sides of block boundaries and are separated by long rejected runs
+	auto s = std::string(200, '.');
+	for (const auto i : {0, 5, 63, 64, 65, 127, 128, 199}) {
+		s[static_cast<std::size_t>(i)] = static_cast<char>('0' + i % 10);
+	}
+	const auto table = fsv::filtered_string_view{s, fsv::classes::digit};
+	const auto generic = fsv::filtered_string_view{s, [](const char& c) { return c >= '0' and c <= '9'; }};
+
+	REQUIRE(std::string(table.begin(), table.end()) == "05345789");
+	REQUIRE(std::ranges::equal(table, generic));
+	REQUIRE(std::ranges::equal(table | std::views::reverse, generic | std::views::reverse));
+}
+
+TEST_CASE("Byte-class iterators change direction inside a block") {
+	auto s = std::string{"..a....b" + std::string(70, '.') + "c..d"};
+	const auto fsv1 = fsv::filtered_string_view{s, fsv::byte_class::range('a', 'z')};
+
+	auto it = fsv1.begin();
+	REQUIRE(*it == 'a');
+	REQUIRE(*++it == 'b');
+	REQUIRE(*++it == 'c');
+	REQUIRE(*--it == 'b');
+	REQUIRE(*--it == 'a');
+	REQUIRE(*++it == 'b');
+	REQUIRE(*++it == 'c');
+	REQUIRE(*++it == 'd');
+	REQUIRE(++it == fsv1.end());
+	REQUIRE(*--it == 'd');
+}
+
+TEST_CASE("Reverse iterators step back and forth and round-trip through base()") {
+	auto s = std::string{"..P...u" + std::string(70, '.') + "g..s"};
+	const auto table = fsv::filtered_string_view{s, fsv::byte_class::range('a', 'z')};
+	const auto generic = fsv::filtered_string_view{s, [](const char& c) { return c >= 'a' and c <= 'z'; }};
+	static_assert(std::bidirectional_iterator<fsv::filtered_string_view::const_reverse_iterator>);
+
+	for (const auto& view : {table, generic}) {
+		REQUIRE(std::string(view.rbegin(), view.rend()) == "sgu");
+		auto rit = view.rbegin();
+		REQUIRE(*++rit == 'g');
+		REQUIRE(*++rit == 'u');
+		REQUIRE(++rit == view.rend());
+		REQUIRE(*--rit == 'u');
+		REQUIRE(rit.base() == std::next(view.begin()));
+		REQUIRE(std::prev(view.rend()).base() == std::next(view.begin()));
+		REQUIRE(view.rend().base() == view.begin());
+		REQUIRE(view.rbegin().base() == view.end());
+	}
+
+	const auto none = fsv::filtered_string_view{s, fsv::classes::digit};
+	REQUIRE(none.rbegin() == none.rend());
+}
+
+TEST_CASE("Byte-class views with no kept characters are empty") {
+	auto s = std::string(130, 'x');
+	const auto fsv1 = fsv::filtered_string_view{s, fsv::classes::digit};
+
+	REQUIRE(fsv1.begin() == fsv1.end());
+	REQUIRE(fsv::substr(fsv::filtered_string_view{s + "7", fsv::classes::digit}).size() == 1);
+}
+
+TEST_CASE("indexed_view models a random access range") {
+	STATIC_REQUIRE(std::random_access_iterator<fsv::indexed_view::const_iterator>);
+	STATIC_REQUIRE(std::ranges::random_access_range<fsv::indexed_view>);
+	STATIC_REQUIRE(std::ranges::sized_range<fsv::indexed_view>);
+	STATIC_REQUIRE(std::ranges::view<fsv::indexed_view>);
+
+	auto s = std::string{"a1b2c3d4e5"};
+	const auto index = fsv::indexed(fsv::filtered_string_view{s, fsv::classes::digit});
+
+	REQUIRE(index.size() == 5);
+	REQUIRE(index[0] == '1');
+	REQUIRE(index[4] == '5');
+	REQUIRE(index.position(2) == 5);
+	REQUIRE(index.end() - index.begin() == 5);
+	REQUIRE(index.begin()[3] == '4');
+	REQUIRE(*(index.end() - 2) == '4');
+	REQUIRE(std::string(index.rbegin(), index.rend()) == "54321");
+	REQUIRE(std::ranges::equal(index, index.view()));
+	REQUIRE_THROWS_WITH(index.at(5), "filtered_string_view::at(5): invalid index");
+}
+
+TEST_CASE("Binary search over an indexed view") {
+	auto s = std::string{"a-c-e-g-i-k-m"};
+	const auto index = fsv::indexed(fsv::filtered_string_view{s, [](const char& c) { return c != '-'; }});
+
+	const auto it = std::lower_bound(index.begin(), index.end(), 'f');
+	REQUIRE(*it == 'g');
+	REQUIRE(it - index.begin() == 3);
+	REQUIRE(&*it == s.data() + 6);
+	REQUIRE(std::distance(index.begin(), index.end()) == 7);
+	REQUIRE(std::ranges::upper_bound(index, 'm') == index.end());
+}
+
+TEST_CASE("Empty indexed views") {
+	const auto empty = fsv::indexed_view();
+	REQUIRE(empty.empty());
+	REQUIRE(empty.begin() == empty.end());
+
+	auto s = std::string{"abc"};
+	const auto none = fsv::indexed(fsv::filtered_string_view{s, fsv::classes::digit});
+	REQUIRE(none.empty());
+	REQUIRE(none.view().original_size() == 3);
+}
+
+TEST_CASE("filter_column filters every row into one buffer") {
+	const auto data = std::string{"Shiba Inu|Akita|  |Basset Hound"};
+	const auto offsets = std::vector<std::size_t>{0, 9, 10, 15, 16, 18, 19, 31};
+	const auto column = fsv::string_column{data, offsets};
+
+	const auto result = fsv::filter_column(column, fsv::classes::upper);
+	REQUIRE(result.rows() == 7);
+	REQUIRE(result.data == "SIABH");
+	REQUIRE(result.offsets == std::vector<std::size_t>{0, 2, 2, 3, 3, 3, 3, 5});
+	REQUIRE(result[0] == "SI");
+	REQUIRE(result[4].empty());
+	REQUIRE(result[6] == "BH");
+
+	const auto lowered = fsv::filter_column(column, [](const char& c) { return c >= 'a' and c <= 'z'; });
+	REQUIRE(lowered[2] == "kita");
+}
+
+TEST_CASE("filter_column matches per-row views on a large column") {
+	auto data = std::string();
+	auto offsets = std::vector<std::size_t>{0};
+	for (std::size_t row = 0; row < 50000; ++row) {
+		for (std::size_t i = 0; i < row % 13; ++i) {
+			data.push_back(static_cast<char>('0' + (row * 7 + i * 3) % 75));
+		}
+		offsets.push_back(data.size());
+	}
+	const auto column = fsv::string_column{data, offsets};
+	const auto result = fsv::filter_column(column, fsv::classes::alnum, fsv::batch_options{.threads = 4});
+
+	REQUIRE(result.rows() == 50000);
+	auto mismatches = 0;
+	for (std::size_t row = 0; row < result.rows(); ++row) {
+		const auto view = fsv::filtered_string_view(data.data() + offsets[row],
+		                                            offsets[row + 1] - offsets[row],
+		                                            fsv::classes::alnum);
+		mismatches += result[row] != static_cast<std::string>(view) ? 1 : 0;
+	}
+	REQUIRE(mismatches == 0);
+}
+
+TEST_CASE("filter_column rejects bad offsets and propagates predicate errors") {
+	const auto data = std::string(200000, 'x');
+	const auto decreasing = std::vector<std::size_t>{0, 5, 3};
+	const auto past_end = std::vector<std::size_t>{0, 200001};
+	REQUIRE_THROWS_AS(fsv::filter_column(fsv::string_column{data, decreasing}, fsv::classes::alpha), std::out_of_range);
+	REQUIRE_THROWS_AS(fsv::filter_column(fsv::string_column{data, past_end}, fsv::classes::alpha), std::out_of_range);
+	REQUIRE(fsv::filter_column(fsv::string_column{}, fsv::classes::alpha).rows() == 0);
+
+	const auto whole = std::vector<std::size_t>{0, data.size()};
+	auto throwing = [](const char&) -> bool { throw std::runtime_error("predicate failed"); };
+	REQUIRE_THROWS_WITH(fsv::filter_column(fsv::string_column{data, whole}, throwing, fsv::batch_options{.threads = 4}),
+	                    "predicate failed");
+}
+
+TEST_CASE("scan counts several filters in one pass") {
+	auto s = std::string{"Border Collie, 3 years; Kelpie, 12 years!"};
+	auto is_punct = [](const char& c) { return std::ispunct(static_cast<unsigned char>(c)) != 0; };
+	const auto filts = std::vector<fsv::filter>{fsv::classes::alpha,
+	                                            fsv::classes::digit,
+	                                            is_punct,
+	                                            fsv::filtered_string_view::default_predicate};
+	// Byte classes are counted from a histogram with the scalar kernels and block by block with the SIMD ones
+	const auto initial = fsv::active_simd_level();
+	for (const auto level : {fsv::simd_level::scalar, fsv::supported_simd_level()}) {
+		fsv::use_simd_level(level);
+		const auto result = fsv::scan(s, filts);
+
+		REQUIRE(result.counts.size() == 4);
+		REQUIRE(result.counts[3] == s.size());
+		for (std::size_t i = 0; i < filts.size(); ++i) {
+			REQUIRE(result.counts[i] == fsv::filtered_string_view{s, filts[i]}.size());
+		}
+		REQUIRE(result.masks.empty());
+		REQUIRE(result.strings.empty());
+	}
+	fsv::use_simd_level(initial);
+}
+
+TEST_CASE("scan produces masks and strings across blocks") {
+	auto s = std::string();
+	for (auto i = 0; i < 150; ++i) {
+		s.push_back(static_cast<char>(i % 3 == 0 ? 'a' + i % 26 : '0' + i % 10));
+	}
+	const auto filts = std::vector<fsv::filter>{fsv::classes::lower, fsv::classes::digit};
+	const auto result = fsv::scan(s, filts, fsv::scan_options{.masks = true, .strings = true});
+
+	for (std::size_t i = 0; i < filts.size(); ++i) {
+		REQUIRE(result.strings[i] == static_cast<std::string>(fsv::filtered_string_view{s, filts[i]}));
+		REQUIRE(result.masks[i].size() == 3);
+	}
+	REQUIRE((result.masks[0][0] & 0b1001001) == 0b1001001);
+	REQUIRE((result.masks[1][0] & 0b0110110) == 0b0110110);
+	REQUIRE((result.masks[0][2] | result.masks[1][2]) == (std::uint64_t{1} << 22) - 1);
+}
+
+TEST_CASE("scan of an empty buffer") {
+	const auto result = fsv::scan("", {fsv::classes::alpha}, fsv::scan_options{.masks = true, .strings = true});
+	REQUIRE(result.counts == std::vector<std::size_t>{0});
+	REQUIRE(result.masks[0].empty());
+	REQUIRE(result.strings[0].empty());
+}
+
+TEST_CASE("Bitmask views keep the same characters as the view they were made from") {
+	auto s = std::string();
+	for (auto i = 0; i < 200; ++i) {
+		s.push_back(static_cast<char>(i % 5 == 0 ? 'A' + i % 26 : 'a' + i % 26));
+	}
+	const auto upper = fsv::filtered_string_view{s, [](const char& c) { return c >= 'A' and c <= 'Z'; }};
+	const auto masked = fsv::masked(upper);
+
+	REQUIRE(masked.data() == s.data());
+	REQUIRE(masked.original_size() == s.size());
+	REQUIRE(masked == upper);
+	REQUIRE(masked.size() == 40);
+	REQUIRE(std::ranges::equal(masked | std::views::reverse, upper | std::views::reverse));
+	REQUIRE(fsv::substr(masked, 3, 10) == fsv::substr(upper, 3, 10));
+	// The selection is tied to the characters of s, not to their values
+	const auto copy = s;
+	REQUIRE(fsv::filtered_string_view{copy, masked.shared_predicate()}.empty());
+}
+
+TEST_CASE("Bitmask set operations") {
+	auto s = std::string{"Pembroke Welsh Corgi 2024"};
+	const auto alpha = fsv::filtered_string_view{s, fsv::classes::alpha};
+	const auto upper = fsv::filtered_string_view{s, fsv::classes::upper};
+	const auto alnum = fsv::filtered_string_view{s, fsv::classes::alnum};
+
+	REQUIRE(static_cast<std::string>(fsv::mask_and(alpha, upper)) == "PWC");
+	REQUIRE(static_cast<std::string>(fsv::mask_xor(alpha, upper)) == "embrokeelshorgi");
+	REQUIRE(static_cast<std::string>(fsv::mask_or(upper, fsv::mask_xor(alnum, alpha))) == "PWC2024");
+	REQUIRE(static_cast<std::string>(fsv::mask_not(alnum)) == "   ");
+	REQUIRE(fsv::mask_not(fsv::mask_not(alpha)) == alpha);
+	REQUIRE(fsv::mask_and(fsv::masked(alpha), fsv::mask_not(alpha)).empty());
+}
+
+TEST_CASE("Bitmask set operations need views over the same characters") {
+	auto s = std::string{"Samoyed"};
+	const auto whole = fsv::filtered_string_view{s};
+	const auto part = fsv::substr(whole, 1, 3);
+
+	REQUIRE_THROWS_AS(fsv::mask_and(whole, part), std::invalid_argument);
+	REQUIRE_THROWS_WITH(fsv::mask_or(whole, fsv::filtered_string_view{std::string_view{"Samoyed"}}),
+	                    "mask_or: the views must cover the same characters");
+	REQUIRE(static_cast<std::string>(fsv::mask_not(fsv::filtered_string_view{})).empty());
+}
+
+TEST_CASE("Views constructed from keep ranges") {
+	auto s = std::string{"The Bernese Mountain Dog is a large breed"};
+	const auto ranges = std::vector<fsv::keep_range>{{4, 7}, {21, 3}, {0, 0}};
+	const auto fsv1 = fsv::filtered_string_view{s, ranges};
+
+	REQUIRE(fsv1.size() == 10);
+	REQUIRE(fsv1[0] == 'B');
+	REQUIRE(fsv1[7] == 'D');
+	REQUIRE(fsv1[10] == '\0');
+	REQUIRE(static_cast<std::string>(fsv1) == "BerneseDog");
+	REQUIRE(std::string(fsv1.rbegin(), fsv1.rend()) == "goDesenreB");
+
+	auto oss = std::ostringstream();
+	oss << fsv1;
+	REQUIRE(oss.str() == "BerneseDog");
+	REQUIRE(fsv::substr(fsv1, 5, 3) == "seD");
+	const auto pieces = fsv::split(fsv1, "D");
+	REQUIRE(pieces.size() == 2);
+	REQUIRE(pieces[0] == "Bernese");
+	REQUIRE(pieces[1] == "og");
+
+	const auto unsorted = std::vector<fsv::keep_range>{{21, 3}, {4, 3}, {5, 4}};
+	REQUIRE(static_cast<std::string>(fsv::filtered_string_view{s, unsorted}) == "BerneDog");
+	REQUIRE(fsv::filtered_string_view{s, std::vector<fsv::keep_range>{}}.empty());
+}
+
+TEST_CASE("Views constructed from a bitmask") {
+	auto s = std::string(130, '-');
+	s[0] = 'x';
+	s[64] = 'y';
+	s[129] = 'z';
+	const auto mask = std::vector<std::uint64_t>{1, 1, ~std::uint64_t{0}};
+	auto fsv1 = fsv::filtered_string_view{s.data(), s.size(), mask};
+
+	REQUIRE(fsv1.size() == 4);
+	REQUIRE(static_cast<std::string>(fsv1) == "xy-z"); // Bits past the end of the data are ignored
+	REQUIRE(fsv1.at(3) == 'z');
+	REQUIRE(not fsv1.empty());
+	REQUIRE(fsv::filtered_string_view{s, std::vector<std::uint64_t>(3)}.empty());
+	REQUIRE(fsv::mask_and(fsv1, fsv::filtered_string_view{s, fsv::classes::alpha}) == "xyz");
+}
+
+TEST_CASE("Bitmask and keep range constructors validate their input") {
+	auto s = std::string(100, 'a');
+	REQUIRE_THROWS_AS((fsv::filtered_string_view{s, std::vector<std::uint64_t>{1}}), std::invalid_argument);
+	REQUIRE_THROWS_AS((fsv::filtered_string_view{s, std::vector<fsv::keep_range>{{90, 11}}}), std::out_of_range);
+	REQUIRE_NOTHROW(fsv::filtered_string_view{s, std::vector<fsv::keep_range>{{90, 10}, {100, 0}}});
+}
+
+TEST_CASE("Every supported SIMD level classifies bytes like the table") {
+	auto s = std::string();
+	for (auto i = 0; i < 64 * 40 + 17; ++i) {
+		s.push_back(static_cast<char>((i * 131 + i / 7) % 256));
+	}
+	const auto classes = std::vector<fsv::byte_class>{fsv::classes::digit,
+	                                                  fsv::classes::alnum,
+	                                                  fsv::classes::punct,
+	                                                  fsv::byte_class::range('\x80', '\xff') | fsv::byte_class::of("a"),
+	                                                  fsv::byte_class()};
+	const auto initial = fsv::active_simd_level();
+	for (auto level = fsv::simd_level::scalar; level <= fsv::supported_simd_level();
+	     level = static_cast<fsv::simd_level>(static_cast<int>(level) + 1))
+	{
+		REQUIRE(fsv::use_simd_level(level) == level);
+		REQUIRE(fsv::active_simd_level() == level);
+		for (const auto& cls : classes) {
+			const auto view = fsv::filtered_string_view{s, cls};
+			const auto reference = fsv::filtered_string_view{s, [&cls](const char& c) { return cls.contains(c); }};
+			CHECK(view.size() == reference.size());
+			CHECK(static_cast<std::string>(view) == static_cast<std::string>(reference));
+			CHECK(std::ranges::equal(view | std::views::reverse, reference | std::views::reverse));
+		}
+	}
+	fsv::use_simd_level(initial);
+}
+
+TEST_CASE("SIMD levels are clamped to what the CPU supports") {
+	const auto initial = fsv::active_simd_level();
+	REQUIRE(fsv::use_simd_level(fsv::simd_level::avx512) == fsv::supported_simd_level());
+	REQUIRE(fsv::use_simd_level(fsv::simd_level::scalar) == fsv::simd_level::scalar);
+	REQUIRE(std::string(fsv::simd_level_name(fsv::simd_level::scalar)) == "scalar");
+	REQUIRE(std::string(fsv::simd_level_name(fsv::simd_level::sse42)) == "SSE4.2");
+	fsv::use_simd_level(initial);
+}
+
+TEST_CASE("write_to writes the kept characters to a file descriptor") {
+	auto fds = std::array<int, 2>();
+	REQUIRE(::pipe(fds.data()) == 0);
+
+	auto s = std::string{"Irish Wolfhound, Scottish Deerhound"};
+	const auto views = std::vector<fsv::filtered_string_view>{
+	    fsv::filtered_string_view{s, [](const char& c) { return c != 'o'; }},
+	    fsv::filtered_string_view{"|"},
+	    fsv::filtered_string_view{s, fsv::classes::upper},
+	    fsv::filtered_string_view{s, fsv::classes::digit},
+	};
+	REQUIRE(fsv::write_to(fds[1], views[0]) == 31);
+	REQUIRE(fsv::write_to(fds[1], std::span(views).subspan(1)) == 5);
+	::close(fds[1]);
+
+	auto out = std::string(64, '\0');
+	out.resize(static_cast<std::size_t>(::read(fds[0], out.data(), out.size())));
+	::close(fds[0]);
+	REQUIRE(out == "Irish Wlfhund, Scttish Deerhund|IWSD");
+}
+
+TEST_CASE("write_to handles more runs than one writev call takes") {
+	auto s = std::string();
+	for (auto i = 0; i < 5000; ++i) {
+		s += "a-";
+	}
+	auto* file = std::tmpfile();
+	REQUIRE(file != nullptr);
+	const auto fd = ::fileno(file);
+
+	REQUIRE(fsv::write_to(fd, fsv::filtered_string_view{s, [](const char& c) { return c == 'a'; }}) == 5000);
+	REQUIRE(::lseek(fd, 0, SEEK_SET) == 0);
+	auto out = std::string(6000, '\0');
+	out.resize(static_cast<std::size_t>(::read(fd, out.data(), out.size())));
+	std::fclose(file);
+	REQUIRE(out == std::string(5000, 'a'));
+}
+
+// A stream buffer recording each write it receives
+class write_recorder : public std::streambuf {
+ public:
+	std::vector<std::string> writes;
+
+ protected:
+	auto xsputn(const char* s, std::streamsize count) -> std::streamsize override {
+		writes.emplace_back(s, static_cast<std::size_t>(count));
+		return count;
+	}
+};
+
+TEST_CASE("Runs of kept characters are not split at 64-byte blocks") {
+	const auto s = std::string(1000, 'a') + "-" + std::string(100, 'b');
+	const auto mask = std::vector<std::uint64_t>(18, ~std::uint64_t{0});
+	const auto table = fsv::filtered_string_view{s, fsv::classes::alpha};
+	const auto bitmask = fsv::filtered_string_view{s.data(), 1000, mask};
+
+	for (const auto& [view, runs] : {std::pair{table, 2}, std::pair{bitmask, 1}}) {
+		auto recorder = write_recorder();
+		auto os = std::ostream(&recorder);
+		os << view;
+		REQUIRE(recorder.writes.size() == static_cast<std::size_t>(runs));
+		REQUIRE(recorder.writes[0] == std::string(1000, 'a'));
+
+		auto* file = std::tmpfile();
+		REQUIRE(file != nullptr);
+		REQUIRE(fsv::write_to(::fileno(file), view) == view.size());
+		std::fclose(file);
+	}
+}
+
+TEST_CASE("write_to reports write errors") {
+	REQUIRE_THROWS_AS(fsv::write_to(-1, fsv::filtered_string_view{"Saluki"}), std::system_error);
+	REQUIRE(fsv::write_to(-1, fsv::filtered_string_view{"Saluki", fsv::classes::digit}) == 0);
+}
+
+TEST_CASE("growing_view counts only the characters appended since the last extend") {
+	auto log = std::string();
+	auto tail = fsv::growing_view(fsv::classes::digit);
+	REQUIRE(tail.empty());
+
+	auto expected = std::size_t{0};
+	for (auto i = 0; i < 300; ++i) {
+		log += "line " + std::to_string(i) + "\n"; // Appending reallocates the buffer from time to time
+		expected += std::to_string(i).size();
+		REQUIRE(tail.extend(log) == expected);
+	}
+	REQUIRE(tail.size() == fsv::filtered_string_view(log, fsv::classes::digit).size());
+	REQUIRE(tail.original_size() == log.size());
+	REQUIRE(tail.view() == fsv::filtered_string_view(log, fsv::classes::digit));
+	REQUIRE(tail[0] == '0');
+	REQUIRE_THROWS_WITH(tail.position(0), "growing_view::position: the view is not indexed");
+}
+
+TEST_CASE("Indexed growing_view keeps the positions of the kept characters") {
+	auto buffer = std::string{"ab1"};
+	auto tail = fsv::growing_view([](const char& c) { return c != 'b'; }, true);
+	REQUIRE(tail.is_indexed());
+	REQUIRE(tail.extend(buffer) == 2);
+
+	buffer += "bbc2";
+	REQUIRE(tail.extend(buffer.data(), buffer.size()) == 4);
+	REQUIRE(tail.position(0) == 0);
+	REQUIRE(tail.position(2) == 5);
+	REQUIRE(tail[3] == '2');
+	REQUIRE(&tail[1] == buffer.data() + 2);
+	REQUIRE(tail[4] == '\0');
+	REQUIRE_THROWS_AS(tail.position(4), std::out_of_range);
+}
+
+TEST_CASE("growing_view rejects a buffer that shrank") {
+	auto buffer = std::string{"Lagotto"};
+	auto tail = fsv::growing_view();
+	REQUIRE(tail.extend(buffer) == 7);
+	REQUIRE(tail.extend(buffer) == 7);
+	REQUIRE_THROWS_AS(tail.extend(buffer.data(), 3), std::invalid_argument);
+	REQUIRE(tail.size() == 7);
+}
+
+TEST_CASE("copy_to copies the kept characters into a caller's buffer") {
+	// 100 characters, so the byte-class predicate crosses a block boundary
+	const auto text = std::string(50, 'a') + std::string(50, 'b');
+	const auto no_a = [](const char& c) { return c != 'a'; };
+	const auto views = std::vector<fsv::filtered_string_view>{
+	    fsv::filtered_string_view(text),
+	    fsv::filtered_string_view(text, fsv::byte_class::of("b")),
+	    fsv::filtered_string_view(text, no_a),
+	};
+
+	for (const auto& view : views) {
+		const auto expected = static_cast<std::string>(view);
+		auto buffer = std::array<char, 128>{};
+		REQUIRE(view.copy_to(buffer.data(), buffer.size()) == expected.size());
+		REQUIRE(std::string(buffer.data(), expected.size()) == expected);
+		REQUIRE(view.copy_to(buffer.data(), 0) == 0);
+	}
+
+	// A short buffer receives the kept characters that fit
+	const auto sv = fsv::filtered_string_view{"abcdefabc", no_a};
+	auto buffer = std::array<char, 4>{};
+	REQUIRE(sv.copy_to(buffer.data(), buffer.size()) == 4);
+	REQUIRE(std::string(buffer.data(), 4) == "bcde");
+	REQUIRE(fsv::filtered_string_view(text, fsv::byte_class::of("ab")).copy_to(buffer.data(), 3) == 3);
+}
+
+TEST_CASE("append_to appends the kept characters to an existing string") {
+	auto out = std::string{"Cavoodle: "};
+	fsv::filtered_string_view{"Cavapoo", [](const char& c) { return c != 'a'; }}.append_to(out);
+	REQUIRE(out == "Cavoodle: Cvpoo");
+
+	auto scratch = std::string();
+	for (const auto* word : {"Schnoodle", "Maltipoo", "Goldendoodle"}) {
+		scratch.clear();
+		fsv::filtered_string_view(word, fsv::classes::lower).append_to(scratch);
+		REQUIRE(scratch == std::string(word).substr(1));
+	}
+
+	fsv::filtered_string_view{"!"}.append_to(out);
+	fsv::filtered_string_view{"", fsv::classes::digit}.append_to(out);
+	REQUIRE(out == "Cavoodle: Cvpoo!");
+}
+
+TEST_CASE("to_string and split draw their results from the given allocator") {
+	// The arena has no upstream, so any allocation that does not fit its buffer throws
+	auto buffer = std::array<std::byte, 1024>{};
+	auto arena = std::pmr::monotonic_buffer_resource(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+
+	const auto sv = fsv::filtered_string_view{"a long enough string, filtered: no vowels", [](const char& c) {
+		                                          return not(c == 'a' or c == 'e' or c == 'i' or c == 'o' or c == 'u');
+	                                          }};
+	const auto text = fsv::pmr::to_string(sv, &arena);
+	REQUIRE(text == " lng ngh strng, fltrd: n vwls");
+	REQUIRE(text.get_allocator().resource() == &arena);
+	REQUIRE(fsv::to_string(sv) == static_cast<std::string>(sv));
+	REQUIRE(fsv::to_string(fsv::filtered_string_view{"Sheepadoodle", fsv::classes::lower},
+	                       std::pmr::polymorphic_allocator<std::byte>(&arena))
+	        == "heepadoodle");
+
+	const auto pieces = fsv::pmr::split(fsv::filtered_string_view{"xax.ybx.z"}, fsv::filtered_string_view{"x"}, &arena);
+	REQUIRE(pieces.get_allocator().resource() == &arena);
+	REQUIRE(pieces.size() == 4);
+	REQUIRE(pieces[1] == "a");
+	REQUIRE(pieces[2] == ".yb");
+	REQUIRE(pieces[3] == ".z");
+}
+
+TEST_CASE("Allocator-aware split matches split") {
+	const auto sv = fsv::filtered_string_view{"0xz0yx0z"};
+	for (const auto* tok : {"0", "x", "0z", "", "q"}) {
+		const auto expected = fsv::split(sv, tok);
+		const auto pieces = fsv::pmr::split(sv, tok);
+		REQUIRE(std::ranges::equal(expected, pieces));
+		REQUIRE(std::ranges::equal(expected, fsv::split(sv, tok, std::allocator<char>())));
+	}
+	REQUIRE(fsv::pmr::split("", "x").size() == 1);
+}
+
+TEST_CASE("filtered_string owns a copy of the kept characters") {
+	auto source = std::make_unique<std::string>("Pomapoo, Pomchi and Pomsky");
+	const auto owned = fsv::filtered_string(fsv::substr(fsv::filtered_string_view{*source, fsv::classes::alpha}, 7));
+	auto pieces = std::vector<fsv::filtered_string>();
+	for (const auto& piece : fsv::split(fsv::filtered_string_view{*source, [](const char& c) { return c != 'P'; }},
+	                                    fsv::filtered_string_view{", "})) {
+		pieces.emplace_back(piece);
+	}
+	source.reset(); // The owned strings do not refer to the source
+
+	REQUIRE(owned.size() == 15);
+	REQUIRE(owned.view() == "PomchiandPomsky");
+	REQUIRE(std::string(owned.data()) == "PomchiandPomsky");
+	REQUIRE(pieces.size() == 2);
+	REQUIRE(pieces[0].view() == "omapoo");
+	REQUIRE(pieces[1].view() == "omchi and omsky");
+	REQUIRE(pieces[1][0] == 'o');
+
+	auto copy = pieces[0];
+	REQUIRE(copy == pieces[0]);
+	REQUIRE(copy.data() != pieces[0].data());
+	auto moved = std::move(copy);
+	REQUIRE(moved.view() == "omapoo");
+	REQUIRE(copy.empty());
+	copy = moved;
+	REQUIRE(copy == moved);
+
+	const auto empty = fsv::filtered_string(fsv::filtered_string_view{"123", fsv::classes::alpha});
+	REQUIRE(empty.empty());
+	REQUIRE(empty == fsv::filtered_string());
+	REQUIRE(*empty.data() == '\0');
+}
+
+TEST_CASE("filtered_string copies generic views re-entrantly and returns its scratch storage") {
+	auto pool = fsv::string_pool();
+	auto inner = std::vector<fsv::filtered_string>();
+	const auto no_o = [](const char& c) { return c != 'o'; };
+	// The predicate copies a view of its own while the outer copy is half built
+	const auto copying = [&](const char& c) {
+		inner.emplace_back(fsv::filtered_string_view{"Poodle", no_o}, pool);
+		return no_o(c);
+	};
+	const auto outer = fsv::filtered_string(fsv::filtered_string_view{"Goldendoodle", copying}, pool);
+	REQUIRE(outer.view() == "Gldenddle");
+	REQUIRE(inner.size() == 12);
+	REQUIRE(std::ranges::all_of(inner, [](const auto& s) { return s.view() == "Pdle"; }));
+
+	// The scratch chunk a copy filters into is handed back, so copying again and again needs no more storage
+	const auto text = std::string(3000, '-') + "Labradoodle";
+	const auto no_dash = [](const char& c) { return c != '-'; };
+	const auto small = fsv::filtered_string(fsv::filtered_string_view{text, no_dash}, pool);
+	REQUIRE(small.view() == "Labradoodle");
+	REQUIRE(fsv::filtered_string(fsv::filtered_string_view{text, no_dash}, pool) == small);
+	const auto slabs = pool.slab_bytes();
+	const auto free_bytes = pool.free_bytes();
+	REQUIRE(free_bytes >= 3000);
+	for (auto i = 0; i < 100; ++i) {
+		REQUIRE(fsv::filtered_string(fsv::filtered_string_view{text, no_dash}, pool) == small);
+	}
+	REQUIRE(pool.slab_bytes() == slabs);
+	REQUIRE(pool.free_bytes() == free_bytes);
+}
+
+TEST_CASE("string_pool reuses released storage") {
+	auto pool = fsv::string_pool();
+	const auto text = std::string(10000, 'x');
+	for (auto round = 0; round < 3; ++round) {
+		auto strings = std::vector<fsv::filtered_string>();
+		for (std::size_t n = 1; n < 2000; n += 7) {
+			strings.emplace_back(fsv::filtered_string_view(text.data(), n), pool);
+		}
+		strings.emplace_back(fsv::filtered_string_view(text), pool); // Larger than a chunk, allocated separately
+		REQUIRE(strings.back().size() == 10000);
+		if (round == 0) {
+			REQUIRE(pool.free_bytes() < fsv::string_pool::slab_size);
+		}
+	}
+	// Every round needs the same storage, so the later rounds allocate no new slabs
+	const auto slabs = pool.slab_bytes();
+	REQUIRE(pool.free_bytes() <= slabs);
+	REQUIRE(pool.free_bytes() > slabs - fsv::string_pool::slab_size); // All but the newest slab's unused tail
+	{
+		auto again = std::vector<fsv::filtered_string>();
+		for (std::size_t n = 1; n < 2000; n += 7) {
+			again.emplace_back(fsv::filtered_string_view(text.data(), n), pool);
+		}
+	}
+	REQUIRE(pool.slab_bytes() == slabs);
+}
+
+TEST_CASE("Views over a shared_buffer keep it alive") {
+	auto text = std::string("Labradoodle, Cockapoo, Goldendoodle");
+	const auto* chars = text.data();
+	auto buffer = fsv::shared_buffer(std::move(text));
+	REQUIRE(buffer.data() == chars); // Moved in, not copied
+	REQUIRE(buffer.use_count() == 1);
+
+	auto pieces = std::vector<fsv::filtered_string_view>();
+	auto letters = fsv::filtered_string_view::const_iterator();
+	auto first = fsv::filtered_string_view();
+	{
+		const auto sv = fsv::filtered_string_view(std::move(buffer), [](const char& c) { return c != 'o'; });
+		REQUIRE_FALSE(buffer);
+		REQUIRE(sv.owner().use_count() == 1);
+		pieces = fsv::split(sv, ", ");
+		letters = std::next(fsv::compose(sv, {fsv::classes::upper}).begin());
+		first = fsv::substr(sv, 0, 6);
+	} // Only derived views and an iterator are left
+
+	REQUIRE(pieces.size() == 3);
+	REQUIRE(pieces[1] == "Cckap");
+	REQUIRE(pieces[2].owner() == first.owner());
+	REQUIRE(first == "Labrad");
+	REQUIRE(*letters == 'C');
+	REQUIRE(first.owner().use_count() == 5);
+	REQUIRE(fsv::masked(first).owner() == first.owner());
+
+	pieces.clear();
+	letters = {};
+	REQUIRE(first.owner().use_count() == 1);
+}
+
+TEST_CASE("Owned views can be handed between threads") {
+	auto sv = fsv::filtered_string_view(fsv::shared_buffer("Bernedoodle 42"), fsv::classes::digit);
+	auto result = std::string();
+	auto worker = std::thread([&result, moved = std::move(sv)] { result = static_cast<std::string>(moved); });
+	worker.join();
+	REQUIRE(result == "42");
+
+	const auto buffer = fsv::shared_buffer(std::string_view("Whoodle"));
+	REQUIRE(buffer.contains(buffer.data() + 2, 5));
+	REQUIRE_FALSE(buffer.contains(buffer.data() + 2, 6));
+	REQUIRE_FALSE(fsv::shared_buffer().contains(buffer.data(), 0));
+	REQUIRE_THROWS_AS(fsv::filtered_string_view("Whoodle", 7, fsv::predicate_handle(), buffer), std::out_of_range);
+	REQUIRE(fsv::filtered_string_view(buffer.data() + 1, 3, fsv::predicate_handle(), buffer) == "hoo");
+}
+
+TEST_CASE("A memoized view runs its predicate once for all of its copies") {
+	auto calls = std::make_shared<int>(0);
+	const auto sv = fsv::filtered_string_view{"Aussiedoodle", [calls](const char& c) {
+		                                          ++*calls;
+		                                          return c != 'o';
+	                                          }};
+	const auto memo = sv.memoized();
+	REQUIRE(memo.is_memoized());
+	REQUIRE_FALSE(sv.is_memoized());
+	// The cache sits behind a pointer-sized handle, like the predicate and the owned buffer
+	static_assert(sizeof(fsv::filtered_string_view) == sizeof(const char*) + sizeof(std::size_t) + 3 * sizeof(void*));
+	REQUIRE(*calls == 0); // Nothing is materialised until it is needed
+
+	const auto copy = memo;
+	REQUIRE(static_cast<std::string>(copy) == "Aussieddle");
+	REQUIRE(*calls == 12);
+	REQUIRE(static_cast<std::string>(memo) == "Aussieddle");
+	REQUIRE(memo.size() == 10);
+	REQUIRE_FALSE(memo.empty());
+	auto out = std::string{"> "};
+	memo.append_to(out);
+	REQUIRE(out == "> Aussieddle");
+	auto buffer = std::array<char, 4>{};
+	REQUIRE(memo.copy_to(buffer.data(), buffer.size()) == 4);
+	REQUIRE(std::string(buffer.data(), 4) == "Auss");
+	REQUIRE(*calls == 12);
+
+	// Derived views and the original compute for themselves
+	REQUIRE(fsv::substr(memo, 1, 3) == "uss");
+	REQUIRE_FALSE(fsv::substr(memo, 1, 3).is_memoized());
+	REQUIRE(sv.size() == 10);
+	REQUIRE(*calls > 12);
+}
+
+TEST_CASE("A memoized view keeps at most max_size characters") {
+	auto calls = std::make_shared<int>(0);
+	const auto sv = fsv::filtered_string_view{"Yorkipoo", [calls](const char& c) {
+		                                          ++*calls;
+		                                          return c != 'o';
+	                                          }}
+	                    .memoized(4);
+	REQUIRE(sv.size() == 5);
+	REQUIRE(*calls == 8);
+	REQUIRE(sv.size() == 5); // The size is cached even though the characters are not
+	REQUIRE(*calls == 8);
+	REQUIRE_FALSE(sv.empty());
+	REQUIRE(*calls == 8);
+	// Characters that are not kept have to be filtered again, into a string reserved from the cached size
+	const auto str = static_cast<std::string>(sv);
+	REQUIRE(str == "Yrkip");
+	REQUIRE(str.capacity() >= 5);
+	REQUIRE(*calls == 16);
+
+	// Byte-class results are counted before anything is copied, so oversized ones are never gathered
+	const auto text = std::string(1000, 'x') + "Yorkipoo";
+	const auto table = fsv::filtered_string_view(text, fsv::byte_class::of("x")).memoized(999);
+	REQUIRE(table.size() == 1000);
+	REQUIRE(static_cast<std::string>(table) == std::string(1000, 'x'));
+	const auto fits = fsv::filtered_string_view(text, fsv::byte_class::of("x")).memoized(1000);
+	REQUIRE(fits.size() == 1000);
+	REQUIRE(static_cast<std::string>(fits) == std::string(1000, 'x'));
+}
+
+TEST_CASE("Memoized views can be materialised from several threads at once") {
+	const auto text = std::string(100000, 'x') + "Poochon";
+	const auto sv = fsv::filtered_string_view(text, fsv::classes::upper | fsv::byte_class::of("hn")).memoized();
+	auto results = std::vector<std::string>(4);
+	auto threads = std::vector<std::thread>();
+	for (auto& result : results) {
+		threads.emplace_back([&result, sv] { result = static_cast<std::string>(sv); });
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	REQUIRE(std::ranges::all_of(results, [](const auto& result) { return result == "Phn"; }));
+}
+
+TEST_CASE("string_cache shares the results of identical views") {
+	auto cache = fsv::string_cache(8);
+	REQUIRE(cache.capacity() == 8);
+	const auto text = std::string("Saint Berdoodle");
+	const auto upper = fsv::predicate_handle(fsv::classes::upper);
+
+	const auto first = cache.get(fsv::filtered_string_view(text, upper));
+	const auto second = cache.get(fsv::filtered_string_view(text, upper)); // A different view of the same thing
+	REQUIRE(*first == "SB");
+	REQUIRE(first == second);
+	REQUIRE(*cache.get(fsv::filtered_string_view(text, fsv::classes::lower)) == "ainterdoodle");
+	REQUIRE(*cache.get(fsv::filtered_string_view(text.data(), 5, upper)) == "S");
+
+	auto stats = cache.stats();
+	REQUIRE(stats.hits == 1);
+	REQUIRE(stats.misses == 3);
+	REQUIRE(stats.entries == 3);
+	REQUIRE(stats.hit_rate() == 0.25);
+
+	// The cache does not see the data change until the range is invalidated
+	auto data = std::string("abc");
+	REQUIRE(*cache.get(fsv::filtered_string_view(data)) == "abc");
+	data[1] = 'x';
+	REQUIRE(*cache.get(fsv::filtered_string_view(data)) == "abc");
+	REQUIRE(cache.invalidate(data.data() + 1, 1) == 1);
+	REQUIRE(*cache.get(fsv::filtered_string_view(data)) == "axc");
+	REQUIRE(cache.invalidate(text.data() + 5, 1) == 2);
+	REQUIRE(cache.stats().entries == 2);
+
+	cache.clear();
+	REQUIRE(cache.stats().entries == 0);
+	REQUIRE(*fsv::cached_string(fsv::filtered_string_view(text, upper)) == "SB");
+}
+
+TEST_CASE("string_cache::invalidate drops the views that share a character with the range") {
+	auto cache = fsv::string_cache(16);
+	const auto text = std::string("Cavapoochon");
+	const auto view = [&](std::size_t offset, std::size_t length) {
+		return fsv::filtered_string_view(text.data() + offset, length);
+	};
+	const auto fill = [&] {
+		cache.clear();
+		for (const auto& [offset, length] : {std::pair{0, 3}, std::pair{3, 3}, std::pair{6, 0}, std::pair{8, 3}}) {
+			cache.get(view(static_cast<std::size_t>(offset), static_cast<std::size_t>(length)));
+		}
+		REQUIRE(cache.stats().entries == 4);
+	};
+
+	fill();
+	REQUIRE(cache.invalidate(text.data() + 3, 0) == 0); // An empty range at the start of a view
+	REQUIRE(cache.invalidate(text.data() + 6, 2) == 1); // Only the empty view at its start
+	fill();
+	REQUIRE(cache.invalidate(text.data() + 5, 4) == 3); // Starts inside one view and ends inside another
+	REQUIRE(cache.stats().entries == 1);
+	REQUIRE(cache.invalidate(text.data() + 9, 0) == 0);
+	REQUIRE(cache.invalidate(text.data() + 2, 1) == 1);
+}
+
+TEST_CASE("string_cache entries keep owned buffers and predicates alive only while cached") {
+	auto cache = fsv::string_cache(256);
+	// Each buffer is freed as soon as its view goes, unless the cache still holds it, so an address it cached can
+	// not come back with other characters
+	for (auto i = 0; i < 100; ++i) {
+		const auto text = std::string(32, static_cast<char>('A' + i % 26)) + std::to_string(i);
+		const auto owned = fsv::filtered_string_view(fsv::shared_buffer(text));
+		REQUIRE(*cache.get(owned) == text);
+	}
+
+	auto captures = std::vector<std::weak_ptr<int>>();
+	const auto text = std::string("Dorkie");
+	for (auto i = 0; i < 100; ++i) {
+		auto capture = std::make_shared<int>(i);
+		captures.push_back(capture);
+		static_cast<void>(cache.get(fsv::filtered_string_view(text, [capture](const char&) { return true; })));
+	}
+	REQUIRE(std::ranges::none_of(captures, [](const auto& capture) { return capture.expired(); }));
+	cache.clear();
+	REQUIRE(std::ranges::all_of(captures, [](const auto& capture) { return capture.expired(); }));
+}
+
+TEST_CASE("string_cache stays within its capacity") {
+	auto cache = fsv::string_cache(16, 4);
+	const auto text = std::string(100, 'x');
+	for (std::size_t n = 0; n < 5; ++n) {
+		REQUIRE(cache.get(fsv::filtered_string_view(text.data(), n))->size() == n);
+	}
+	REQUIRE(cache.get(fsv::filtered_string_view(text))->size() == 100); // Too long to keep
+	REQUIRE(cache.stats().entries == 5);
+
+	for (std::size_t n = 0; n < 64; ++n) {
+		static_cast<void>(cache.get(fsv::filtered_string_view(text.data() + 1 + n, 2)));
+	}
+	const auto stats = cache.stats();
+	REQUIRE(stats.entries == 16);
+	REQUIRE(stats.evictions == 5 + 64 - 16);
+
+	auto none = fsv::string_cache(0);
+	REQUIRE(*none.get(fsv::filtered_string_view("Puggle")) == "Puggle");
+	REQUIRE(none.stats().entries == 0);
+}
+
+TEST_CASE("at() finds the character and checks the index in one pass") {
+	auto calls = std::make_shared<int>(0);
+	auto sv = fsv::filtered_string_view{"Bichpoo Bichon", [calls](const char& c) {
+		                                    ++*calls;
+		                                    return c != 'o';
+	                                    }};
+	REQUIRE(sv.at(3) == 'h');
+	REQUIRE(*calls == 4);
+	*calls = 0;
+	REQUIRE_THROWS_WITH(sv.at(11), "filtered_string_view::at(11): invalid index");
+	REQUIRE(*calls == 14);
+	*calls = 0;
+	REQUIRE_THROWS_AS(sv.at(-1), std::domain_error);
+	REQUIRE(*calls == 0);
+
+	// Byte-class views step a block at a time, memoized views reject indices past their cached size without a scan
+	const auto text = std::string(200, '.') + "Xy" + std::string(100, '.');
+	auto letters = fsv::filtered_string_view(text, fsv::classes::alpha);
+	REQUIRE(letters.at(1) == 'y');
+	REQUIRE(&letters.at(0) == text.data() + 200);
+	REQUIRE_THROWS_WITH(letters.at(2), "filtered_string_view::at(2): invalid index");
+	auto memo = sv.memoized();
+	REQUIRE(memo.size() == 11);
+	*calls = 0;
+	REQUIRE_THROWS_AS(memo.at(11), std::domain_error);
+	REQUIRE(memo.at(10) == 'n');
+	REQUIRE(*calls == 14);
+}